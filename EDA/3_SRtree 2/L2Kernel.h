@@ -0,0 +1,228 @@
+#ifndef L2_KERNEL_H
+#define L2_KERNEL_H
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define L2_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// Distancia euclidiana al cuadrado entre dos vectores de float, y de un
+// punto a una caja. La version vectorizada (AVX-512 o AVX2 + FMA) se elige
+// una sola vez en tiempo de ejecucion segun el CPU; sin soporte queda el
+// bucle escalar.
+namespace l2 {
+
+using Kernel = float (*)(const float *, const float *, std::size_t);
+using BoxKernel = float (*)(const float *, const float *, const float *,
+                            std::size_t);
+
+inline float squaredScalar(const float *a, const float *b, std::size_t n) {
+  float sum = 0.0f;
+  for (std::size_t i = 0; i < n; ++i) {
+    float diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+// Por dimension, lo que p queda fuera de [lo, hi] (0 si esta dentro)
+inline float boxScalar(const float *p, const float *lo, const float *hi,
+                       std::size_t n) {
+  float sum = 0.0f;
+  for (std::size_t i = 0; i < n; ++i) {
+    float out = lo[i] - p[i] > p[i] - hi[i] ? lo[i] - p[i] : p[i] - hi[i];
+    if (out > 0.0f)
+      sum += out * out;
+  }
+  return sum;
+}
+
+#ifdef L2_KERNEL_X86
+__attribute__((target("sse3"))) inline float hsum128(__m128 v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_movehdup_ps(v));
+  return _mm_cvtss_f32(v);
+}
+
+// Cuatro acumuladores independientes para no esperar la latencia del FMA
+__attribute__((target("avx2,fma"))) inline float
+squaredAvx2(const float *a, const float *b, std::size_t n) {
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8),
+                              _mm256_loadu_ps(b + i + 8));
+    __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16),
+                              _mm256_loadu_ps(b + i + 16));
+    __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24),
+                              _mm256_loadu_ps(b + i + 24));
+    acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+    acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+    acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    acc0 = _mm256_fmadd_ps(d, d, acc0);
+  }
+  __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1),
+                             _mm256_add_ps(acc2, acc3));
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                           _mm256_extractf128_ps(acc, 1));
+  return hsum128(half) + squaredScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) inline float
+boxAvx2(const float *p, const float *lo, const float *hi, std::size_t n) {
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 acc0 = zero, acc1 = zero;
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 p0 = _mm256_loadu_ps(p + i), p1 = _mm256_loadu_ps(p + i + 8);
+    __m256 o0 = _mm256_max_ps(
+        _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(lo + i), p0),
+                      _mm256_sub_ps(p0, _mm256_loadu_ps(hi + i))),
+        zero);
+    __m256 o1 = _mm256_max_ps(
+        _mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(lo + i + 8), p1),
+                      _mm256_sub_ps(p1, _mm256_loadu_ps(hi + i + 8))),
+        zero);
+    acc0 = _mm256_fmadd_ps(o0, o0, acc0);
+    acc1 = _mm256_fmadd_ps(o1, o1, acc1);
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                           _mm256_extractf128_ps(acc, 1));
+  return hsum128(half) + boxScalar(p + i, lo + i, hi + i, n - i);
+}
+
+// Suma horizontal plegando bloques de 128 bits y luego dentro de cada
+// bloque. Las variantes con mascara evitan el aviso espurio de GCC 12 sobre
+// _mm512_undefined_ps en reduce/extract.
+__attribute__((target("avx512f"))) inline float hsum512(__m512 acc) {
+  acc = _mm512_add_ps(acc, _mm512_mask_shuffle_f32x4(acc, 0xFFFF, acc, acc,
+                                                     0x4E));
+  acc = _mm512_add_ps(acc, _mm512_mask_shuffle_f32x4(acc, 0xFFFF, acc, acc,
+                                                     0xB1));
+  acc = _mm512_add_ps(acc, _mm512_mask_permute_ps(acc, 0xFFFF, acc, 0x4E));
+  acc = _mm512_add_ps(acc, _mm512_mask_permute_ps(acc, 0xFFFF, acc, 0xB1));
+  return _mm512_cvtss_f32(acc);
+}
+
+__attribute__((target("avx512f"))) inline float
+squaredAvx512(const float *a, const float *b, std::size_t n) {
+  __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+  __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16),
+                              _mm512_loadu_ps(b + i + 16));
+    __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32),
+                              _mm512_loadu_ps(b + i + 32));
+    __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48),
+                              _mm512_loadu_ps(b + i + 48));
+    acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+    acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    acc2 = _mm512_fmadd_ps(d2, d2, acc2);
+    acc3 = _mm512_fmadd_ps(d3, d3, acc3);
+  }
+  // Cola con mascara: sin bucle escalar al final
+  for (; i < n; i += 16) {
+    __mmask16 m = n - i >= 16 ? __mmask16(0xFFFF)
+                              : __mmask16((1u << (n - i)) - 1);
+    __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i),
+                             _mm512_maskz_loadu_ps(m, b + i));
+    acc0 = _mm512_fmadd_ps(d, d, acc0);
+  }
+  return hsum512(
+      _mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+}
+
+// max(lo - p, p - hi, 0) por componente. max con mascara completa por la
+// misma razon que en hsum512
+__attribute__((target("avx512f"))) inline __m512 outside512(__m512 pv,
+                                                            __m512 lv,
+                                                            __m512 hv) {
+  __m512 o = _mm512_maskz_max_ps(0xFFFF, _mm512_sub_ps(lv, pv),
+                                 _mm512_sub_ps(pv, hv));
+  return _mm512_maskz_max_ps(0xFFFF, o, _mm512_setzero_ps());
+}
+
+__attribute__((target("avx512f"))) inline float
+boxAvx512(const float *p, const float *lo, const float *hi, std::size_t n) {
+  const __m512 zero = _mm512_setzero_ps();
+  __m512 acc0 = zero, acc1 = zero;
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m512 o0 = outside512(_mm512_loadu_ps(p + i), _mm512_loadu_ps(lo + i),
+                           _mm512_loadu_ps(hi + i));
+    __m512 o1 =
+        outside512(_mm512_loadu_ps(p + i + 16), _mm512_loadu_ps(lo + i + 16),
+                   _mm512_loadu_ps(hi + i + 16));
+    acc0 = _mm512_fmadd_ps(o0, o0, acc0);
+    acc1 = _mm512_fmadd_ps(o1, o1, acc1);
+  }
+  // Cola con mascara; fuera de la mascara todo es 0 y no suma
+  for (; i < n; i += 16) {
+    __mmask16 m = n - i >= 16 ? __mmask16(0xFFFF)
+                              : __mmask16((1u << (n - i)) - 1);
+    __m512 o = outside512(_mm512_maskz_loadu_ps(m, p + i),
+                          _mm512_maskz_loadu_ps(m, lo + i),
+                          _mm512_maskz_loadu_ps(m, hi + i));
+    acc0 = _mm512_fmadd_ps(o, o, acc0);
+  }
+  return hsum512(_mm512_add_ps(acc0, acc1));
+}
+#endif
+
+// Nombre del nucleo que usa squared en este CPU
+inline const char *kernelName() {
+#ifdef L2_KERNEL_X86
+  if (__builtin_cpu_supports("avx512f"))
+    return "avx512";
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return "avx2";
+#endif
+  return "scalar";
+}
+
+inline Kernel selectKernel() {
+#ifdef L2_KERNEL_X86
+  if (__builtin_cpu_supports("avx512f"))
+    return squaredAvx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return squaredAvx2;
+#endif
+  return squaredScalar;
+}
+
+inline float squared(const float *a, const float *b, std::size_t n) {
+  static const Kernel kernel = selectKernel();
+  return kernel(a, b, n);
+}
+
+inline BoxKernel selectBoxKernel() {
+#ifdef L2_KERNEL_X86
+  if (__builtin_cpu_supports("avx512f"))
+    return boxAvx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return boxAvx2;
+#endif
+  return boxScalar;
+}
+
+// Distancia al cuadrado de p a la caja [lo, hi]
+inline float boxSquared(const float *p, const float *lo, const float *hi,
+                        std::size_t n) {
+  static const BoxKernel kernel = selectBoxKernel();
+  return kernel(p, lo, hi, n);
+}
+
+} // namespace l2
+
+#endif // L2_KERNEL_H
@@ -0,0 +1,192 @@
+#ifndef LEAF_BLOCK_H
+#define LEAF_BLOCK_H
+
+#include "L2Kernel.h"
+#include "Point.h"
+#include "Quantizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Coordenadas de los puntos de una hoja en un solo bloque alineado a 64
+// bytes, una fila de DIM floats por punto, para que recorrer la hoja sea
+// una pasada secuencial en lugar de seguir punteros. Sin codigos el bloque
+// es la unica copia de los puntos: point(i) apunta a su fila y deja de ser
+// valido si el bloque crece. Con dimBlock = B la distancia de cada punto se
+// acumula de a B dimensiones y se abandona apenas la suma parcial supera la
+// cota. Con un Quantizer la hoja guarda codigos y las distancias son
+// aproximadas; error(i) acota cuanto se alejan de las exactas.
+class LeafBlock {
+public:
+  static constexpr std::size_t kAlign = 64;
+
+  explicit LeafBlock(std::size_t dimBlock = 0,
+                     const Quantizer *codec = nullptr)
+      : _data(nullptr), _size(0), _capacity(0), _dimBlock(dimBlock),
+        _codec(codec) {
+    checkDimBlock(dimBlock);
+    if (codec && dimBlock)
+      throw std::invalid_argument(
+          "LeafBlock: los codigos no admiten bloques de dimensiones");
+  }
+  ~LeafBlock() { release(); }
+
+  LeafBlock(const LeafBlock &) = delete;
+  LeafBlock &operator=(const LeafBlock &) = delete;
+  LeafBlock(LeafBlock &&other) noexcept
+      : _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)),
+        _capacity(std::exchange(other._capacity, 0)),
+        _dimBlock(other._dimBlock), _codec(other._codec),
+        _codes(std::move(other._codes)), _errors(std::move(other._errors)) {}
+  LeafBlock &operator=(LeafBlock &&other) noexcept {
+    if (this != &other) {
+      release();
+      _data = std::exchange(other._data, nullptr);
+      _size = std::exchange(other._size, 0);
+      _capacity = std::exchange(other._capacity, 0);
+      _dimBlock = other._dimBlock;
+      _codec = other._codec;
+      _codes = std::move(other._codes);
+      _errors = std::move(other._errors);
+    }
+    return *this;
+  }
+
+  // Los bloques deben cubrir DIM exacto y mantener la alineacion
+  static void checkDimBlock(std::size_t dimBlock) {
+    if (dimBlock && (DIM % dimBlock || dimBlock % 16))
+      throw std::invalid_argument(
+          "LeafBlock: dimBlock debe dividir DIM y ser multiplo de 16");
+  }
+
+  std::size_t size() const { return _size; }
+  std::size_t capacity() const { return _capacity; }
+  std::size_t dimBlock() const { return _dimBlock; }
+  const Quantizer *codec() const { return _codec; }
+  bool quantized() const { return _codec != nullptr; }
+  // nullptr si la hoja guarda codigos
+  const float *data() const { return _data; }
+  // Fila del punto i; solo sin codigos
+  Point *point(std::size_t i) const {
+    return reinterpret_cast<Point *>(_data + i * DIM);
+  }
+  // Distancia exacta entre el punto i y su reconstruccion (0 sin codigos)
+  float error(std::size_t i) const { return _codec ? _errors[i] : 0.0f; }
+
+  // Bytes reservados para las coordenadas
+  std::size_t bytes() const {
+    if (_codec)
+      return _codes.capacity() + _errors.capacity() * sizeof(float);
+    return _capacity * DIM * sizeof(float);
+  }
+
+  void clear() {
+    _size = 0;
+    _codes.clear();
+    _errors.clear();
+  }
+
+  void reserve(std::size_t capacity) {
+    if (capacity <= _capacity)
+      return;
+    if (_codec) {
+      _codes.reserve(capacity * _codec->codeBytes());
+      _errors.reserve(capacity);
+      _capacity = capacity;
+      return;
+    }
+    float *fresh = static_cast<float *>(::operator new(
+        capacity * DIM * sizeof(float), std::align_val_t(kAlign)));
+    if (_size)
+      std::memcpy(fresh, _data, _size * DIM * sizeof(float));
+    release();
+    _data = fresh;
+    _capacity = capacity;
+  }
+
+  void push(const Point &p) {
+    if (_size == _capacity)
+      reserve(std::max<std::size_t>(8, 2 * _capacity));
+    if (_codec) {
+      const std::size_t n = _codec->codeBytes();
+      _codes.resize(_codes.size() + n);
+      unsigned char *code = _codes.data() + _size * n;
+      _codec->encode(p, code);
+      alignas(kAlign) float row[DIM];
+      _codec->decode(code, row);
+      _errors.push_back(std::sqrt(l2::squared(p.data(), row, DIM)));
+      _size++;
+      return;
+    }
+    std::memcpy(_data + _size * DIM, p.data(), DIM * sizeof(float));
+    _size++;
+  }
+
+  // Coordenada d del punto i (reconstruida si hay codigos)
+  float at(std::size_t i, std::size_t d) const {
+    if (_codec) {
+      alignas(kAlign) float row[DIM];
+      _codec->decode(_codes.data() + i * _codec->codeBytes(), row);
+      return row[d];
+    }
+    return _data[i * DIM + d];
+  }
+
+  // out[i] = distancia al cuadrado de q al punto i. Con dimBlock, un punto
+  // cuya suma parcial ya supera bound deja de acumularse: su valor queda por
+  // encima de bound pero no es la distancia exacta. Con codigos se mide
+  // contra la reconstruccion de cada punto y bound no se usa.
+  void
+  squaredDistances(const float *q, float *out,
+                   float bound = std::numeric_limits<float>::max()) const {
+    if (_codec) {
+      alignas(kAlign) float row[DIM];
+      const std::size_t n = _codec->codeBytes();
+      for (std::size_t i = 0; i < _size; ++i) {
+        _codec->decode(_codes.data() + i * n, row);
+        out[i] = l2::squared(q, row, DIM);
+      }
+      return;
+    }
+    if (!_dimBlock) {
+      for (std::size_t i = 0; i < _size; ++i)
+        out[i] = l2::squared(q, _data + i * DIM, DIM);
+      return;
+    }
+    for (std::size_t i = 0; i < _size; ++i) {
+      const float *row = _data + i * DIM;
+      float sum = 0.0f;
+      for (std::size_t d = 0; d < DIM && sum <= bound; d += _dimBlock)
+        sum += l2::squared(q + d, row + d, _dimBlock);
+      out[i] = sum;
+    }
+  }
+
+private:
+  float *_data;
+  std::size_t _size;
+  std::size_t _capacity;
+  std::size_t _dimBlock; // 0 = sin abandono temprano
+  const Quantizer *_codec; // nullptr = floats sin perdida
+  std::vector<unsigned char> _codes;
+  std::vector<float> _errors;
+
+  // Point es solo un arreglo de DIM floats: una fila es un Point
+  static_assert(sizeof(Point) == DIM * sizeof(float),
+                "Point debe ser DIM floats contiguos");
+
+  void release() {
+    if (_data)
+      ::operator delete(_data, std::align_val_t(kAlign));
+    _data = nullptr;
+  }
+};
+
+#endif // LEAF_BLOCK_H
@@ -2,6 +2,9 @@
 #define MBB_H
 
 #include "Point.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 using namespace std;
 
@@ -36,5 +39,35 @@ struct MBB {
     }
     return sqrt(maxDistSq);
   }
+  // MINDIST: distancia de p al punto mas cercano de la caja (0 si esta
+  // dentro). Cota inferior de la distancia a todo lo que contiene.
+  static float minDist(const Point &p, const MBB &box) {
+    return sqrt(l2::boxSquared(p.data(), box.minCorner.data(),
+                               box.maxCorner.data(), DIM));
+  }
+  // MINMAXDIST (Roussopoulos et al.): si cada cara de la caja toca algun
+  // punto, hay un punto a lo mas a esta distancia de p. Para cada
+  // dimension k se toma la cara mas cercana en k y la esquina mas lejana en
+  // las demas; el resultado es el minimo sobre k.
+  // Se acumula en double: la resta farSq - far^2 pierde precision en float
+  static float minMaxDist(const Point &p, const MBB &box) {
+    double farSq = 0.0;
+    for (size_t i = 0; i < DIM; ++i) {
+      float mid = (box.minCorner[i] + box.maxCorner[i]) / 2.0f;
+      float far = p[i] >= mid ? p[i] - box.minCorner[i]
+                              : box.maxCorner[i] - p[i];
+      farSq += double(far) * far;
+    }
+    double best = numeric_limits<double>::max();
+    for (size_t k = 0; k < DIM; ++k) {
+      float mid = (box.minCorner[k] + box.maxCorner[k]) / 2.0f;
+      float near = p[k] <= mid ? p[k] - box.minCorner[k]
+                               : box.maxCorner[k] - p[k];
+      float far = p[k] >= mid ? p[k] - box.minCorner[k]
+                              : box.maxCorner[k] - p[k];
+      best = min(best, farSq - double(far) * far + double(near) * near);
+    }
+    return static_cast<float>(sqrt(max(0.0, best)));
+  }
 };
 #endif // MBB_H
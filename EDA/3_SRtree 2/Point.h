@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <random>
 
+#include "L2Kernel.h"
+
 constexpr std::size_t DIM = 768;
 constexpr float EPSILON = 1e-8f;
 
@@ -27,8 +29,12 @@ public:
     float  operator[](std::size_t index) const; 
     float& operator[](std::size_t index);
 
+    const float* data() const;
+
     static Point random(float min = 0.0f, float max = 1.0f);
     static float distance(const Point& p1, const Point& p2);
+    // Sin sqrt: para comparar distancias basta el cuadrado
+    static float squaredDistance(const Point& p1, const Point& p2);
 
 private:
     std::array<float, DIM> coordinates_;
@@ -131,6 +137,11 @@ float& Point::operator[](std::size_t index) {
 }
 
 
+const float* Point::data() const {
+    return coordinates_.data();
+}
+
+
 static std::mt19937& global_engine() {
     static std::random_device rd;
     static std::mt19937 eng(rd());
@@ -145,12 +156,10 @@ Point Point::random(float min, float max) {
 
 
 float Point::distance(const Point& p1, const Point& p2) {
-    float sum = 0.0f;
-    for (std::size_t i = 0; i < DIM; ++i) {
-        float diff = p1.coordinates_[i] - p2.coordinates_[i];
-        sum += diff * diff;
-    }
-    return std::sqrt(sum);
+    return std::sqrt(squaredDistance(p1, p2));
+}
+float Point::squaredDistance(const Point& p1, const Point& p2) {
+    return l2::squared(p1.coordinates_.data(), p2.coordinates_.data(), DIM);
 }
 
 
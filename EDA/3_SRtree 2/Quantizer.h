@@ -0,0 +1,188 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include "Point.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// Formatos de las coordenadas guardadas en las hojas
+enum class Codec {
+  Float32, // sin perdida
+  Float16, // media precision IEEE
+  Int8     // entero por dimension con escala y desplazamiento propios
+};
+
+// Codifica puntos en Float16 o Int8. Int8 ajusta por dimension el rango
+// [min, max] de los puntos de entrenamiento a 0..255; fuera del rango se
+// recorta. decode reconstruye floats para medir con l2::squared.
+class Quantizer {
+public:
+  Quantizer(Codec codec, const std::vector<const Point *> &sample)
+      : _codec(codec), _offset(DIM, 0.0f), _scale(DIM, 1.0f) {
+    if (codec != Codec::Int8 || sample.empty())
+      return;
+    for (std::size_t d = 0; d < DIM; ++d) {
+      float lo = std::numeric_limits<float>::max();
+      float hi = std::numeric_limits<float>::lowest();
+      for (const Point *p : sample) {
+        lo = std::min(lo, (*p)[d]);
+        hi = std::max(hi, (*p)[d]);
+      }
+      _offset[d] = lo;
+      _scale[d] = hi > lo ? (hi - lo) / 255.0f : 1.0f;
+    }
+  }
+
+  Codec codec() const { return _codec; }
+  // Bytes del codigo de un punto
+  std::size_t codeBytes() const {
+    switch (_codec) {
+    case Codec::Float16:
+      return DIM * sizeof(std::uint16_t);
+    case Codec::Int8:
+      return DIM;
+    default:
+      return DIM * sizeof(float);
+    }
+  }
+
+  void encode(const Point &p, unsigned char *out) const {
+    const float *x = p.data();
+    switch (_codec) {
+    case Codec::Float32:
+      std::memcpy(out, x, DIM * sizeof(float));
+      break;
+    case Codec::Float16: {
+      std::uint16_t *h = reinterpret_cast<std::uint16_t *>(out);
+      for (std::size_t d = 0; d < DIM; ++d)
+        h[d] = toHalf(x[d]);
+      break;
+    }
+    case Codec::Int8:
+      for (std::size_t d = 0; d < DIM; ++d) {
+        float v = std::round((x[d] - _offset[d]) / _scale[d]);
+        out[d] = static_cast<unsigned char>(std::clamp(v, 0.0f, 255.0f));
+      }
+      break;
+    }
+  }
+
+  void decode(const unsigned char *code, float *out) const {
+    switch (_codec) {
+    case Codec::Float32:
+      std::memcpy(out, code, DIM * sizeof(float));
+      break;
+    case Codec::Float16:
+      decodeHalf(reinterpret_cast<const std::uint16_t *>(code), out);
+      break;
+    case Codec::Int8:
+      decodeInt8(code, _offset.data(), _scale.data(), out);
+      break;
+    }
+  }
+
+  static std::uint16_t toHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const std::uint32_t sign = (bits >> 16) & 0x8000u;
+    const std::uint32_t absBits = bits & 0x7FFFFFFFu;
+    if (absBits >= 0x7F800000u) // inf o NaN
+      return sign | 0x7C00u | (absBits > 0x7F800000u ? 0x200u : 0);
+    if (absBits >= 0x477FF000u) // fuera de rango al redondear
+      return sign | 0x7C00u;
+    if (absBits < 0x38800000u) { // subnormal en media precision
+      float magnitude;
+      std::memcpy(&magnitude, &absBits, sizeof(magnitude));
+      return sign | static_cast<std::uint16_t>(
+                        std::nearbyint(magnitude * 16777216.0f));
+    }
+    // Redondeo al par mas cercano sobre los 13 bits que se descartan
+    std::uint32_t rounded = absBits + 0xFFFu + ((absBits >> 13) & 1u);
+    return sign | static_cast<std::uint16_t>((rounded - 0x38000000u) >> 13);
+  }
+
+  static float fromHalf(std::uint16_t h) {
+    const std::uint32_t sign = (h & 0x8000u) << 16;
+    const std::uint32_t exponent = (h >> 10) & 0x1Fu;
+    const std::uint32_t mantissa = h & 0x3FFu;
+    std::uint32_t bits;
+    if (exponent == 0) {
+      float magnitude = mantissa / 16777216.0f;
+      std::memcpy(&bits, &magnitude, sizeof(bits));
+      bits |= sign;
+    } else if (exponent == 31) {
+      bits = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+private:
+  Codec _codec;
+  std::vector<float> _offset;
+  std::vector<float> _scale;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __attribute__((target("avx,f16c"))) static void
+  decodeHalfF16c(const std::uint16_t *h, float *out) {
+    for (std::size_t d = 0; d < DIM; d += 8)
+      _mm256_storeu_ps(out + d, _mm256_cvtph_ps(_mm_loadu_si128(
+                                    reinterpret_cast<const __m128i *>(h + d))));
+  }
+#endif
+
+  static void decodeHalf(const std::uint16_t *h, float *out) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool f16c = __builtin_cpu_supports("f16c");
+    if (f16c && DIM % 8 == 0) {
+      decodeHalfF16c(h, out);
+      return;
+    }
+#endif
+    for (std::size_t d = 0; d < DIM; ++d)
+      out[d] = fromHalf(h[d]);
+  }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __attribute__((target("avx2,fma"))) static void
+  decodeInt8Avx2(const unsigned char *code, const float *offset,
+                 const float *scale, float *out) {
+    for (std::size_t d = 0; d < DIM; d += 8) {
+      __m256 c = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(code + d))));
+      _mm256_storeu_ps(out + d, _mm256_fmadd_ps(_mm256_loadu_ps(scale + d), c,
+                                                _mm256_loadu_ps(offset + d)));
+    }
+  }
+#endif
+
+  // El bucle escalar no se vectoriza solo: out puede solaparse con las
+  // tablas de escala
+  static void decodeInt8(const unsigned char *code, const float *offset,
+                         const float *scale, float *out) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool avx2 =
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (avx2 && DIM % 8 == 0) {
+      decodeInt8Avx2(code, offset, scale, out);
+      return;
+    }
+#endif
+    for (std::size_t d = 0; d < DIM; ++d)
+      out[d] = offset[d] + scale[d] * code[d];
+  }
+};
+
+#endif // QUANTIZER_H
@@ -1,30 +1,104 @@
 #ifndef SRTREE_H
 #define SRTREE_H
 
+#include "LeafBlock.h"
 #include "MBB.h"
 #include "Point.h"
+#include "Quantizer.h"
 #include "Sphere.h"
+#include "VectorFile.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <deque>
 #include <limits>
+#include <memory>
+#include <numeric>
 #include <queue>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 using namespace std;
 
+// Contadores de una consulta
+struct SRQueryStats {
+  size_t distanceComputations = 0;
+  // Nodos cuyas entradas se recorrieron
+  size_t nodesVisited = 0;
+
+  SRQueryStats &operator+=(const SRQueryStats &other) {
+    distanceComputations += other.distanceComputations;
+    nodesVisited += other.nodesVisited;
+    return *this;
+  }
+};
+
+// Arreglo de capacidad fija: hasta N elementos viven dentro del objeto, en
+// la pila de llamadas; solo una capacidad mayor reserva memoria
+template <class T, size_t N> class FixedBuffer {
+public:
+  explicit FixedBuffer(size_t capacity) : _data(_inline) {
+    if (capacity > N) {
+      _heap.reset(new T[capacity]);
+      _data = _heap.get();
+    }
+  }
+  FixedBuffer(const FixedBuffer &) = delete;
+  FixedBuffer &operator=(const FixedBuffer &) = delete;
+
+  T *data() { return _data; }
+  T &operator[](size_t i) { return _data[i]; }
+
+private:
+  T _inline[N];
+  unique_ptr<T[]> _heap;
+  T *_data;
+};
+
+class SRNode;
+
+// Pila para recorrer en profundidad, con la capacidad que pide la altura.
+// push verifica la capacidad: un nodo con mas hijos de los previstos
+// lanza en lugar de escribir fuera del arreglo
+class NodeStack {
+public:
+  explicit NodeStack(size_t capacity)
+      : _nodes(capacity), _size(0), _capacity(capacity) {}
+  void push(SRNode *node) {
+    if (_size == _capacity)
+      throw length_error("NodeStack: se excedio la capacidad de la pila");
+    _nodes[_size++] = node;
+  }
+  SRNode *pop() { return _nodes[--_size]; }
+  bool empty() const { return _size == 0; }
+
+private:
+  FixedBuffer<SRNode *, 256> _nodes;
+  size_t _size;
+  size_t _capacity;
+};
+
 class SRNode {
 private:
   MBB _boundingBox;
   Sphere _boundingSphere;
   SRNode *_parent;
+  // Sin codigos apunta a las filas de _block; con codigos, a los puntos
+  // completos que guarda el arbol
   vector<Point *> _points;
+  // Coordenadas de _points, en el mismo orden, contiguas (solo hojas)
+  LeafBlock _block;
   vector<SRNode *> _children;
   bool _isLeaf;
 
 public:
   SRNode() : _parent(nullptr), _isLeaf(true) {}
+  explicit SRNode(size_t dimBlock, const Quantizer *codec = nullptr)
+      : _parent(nullptr), _block(dimBlock, codec), _isLeaf(true) {}
 
   bool getIsLeaf() const { return _isLeaf; }
   SRNode *getParent() const { return _parent; }
@@ -32,6 +106,7 @@ public:
   const MBB &getBoundingBox() const { return _boundingBox; }
   const Sphere &getBoundingSphere() const { return _boundingSphere; }
   const vector<Point *> &getPoints() const { return _points; }
+  const LeafBlock &getBlock() const { return _block; }
   const vector<SRNode *> &getChildren() const { return _children; }
 
   void setBoundingSphere(const Sphere &sphere) { _boundingSphere = sphere; }
@@ -39,6 +114,28 @@ public:
   void setIsLeaf(bool isLeaf) { _isLeaf = isLeaf; }
   void setChildren(const vector<SRNode *> &children) { _children = children; }
 
+  // Reemplaza los puntos de la hoja y vuelve a armar su bloque con el codec
+  // dado; no recalcula los volumenes. points puede apuntar al bloque actual:
+  // el nuevo se arma antes de soltarlo.
+  void setPoints(const vector<Point *> &points, const Quantizer *codec) {
+    LeafBlock nuevo(_block.dimBlock(), codec);
+    nuevo.reserve(points.size());
+    for (Point *p : points)
+      nuevo.push(*p);
+    _block = std::move(nuevo);
+    _points = points;
+    enlazarFilas();
+  }
+
+  // Sin codigos, vuelve a apuntar _points a las filas del bloque tras
+  // armarlo o hacerlo crecer
+  void enlazarFilas() {
+    if (_block.quantized())
+      return;
+    for (size_t i = 0; i < _points.size(); ++i)
+      _points[i] = _block.point(i);
+  }
+
   void calcularEsfera() {
     if (_isLeaf) {
       _boundingSphere = esferaPuntos(_points);
@@ -71,6 +168,27 @@ public:
     }
   }
 
+  // Agranda caja y esfera lo justo para cubrir p, sin recorrer los puntos
+  // del nodo. La esfera nueva es la menor que contiene a la anterior y a p.
+  // Los volumenes exactos se recalculan solo al dividir (ver insert).
+  void expandirVolumenes(const Point &p) {
+    if (_isLeaf && _points.size() == 1) {
+      _boundingBox.minCorner = _boundingBox.maxCorner = p;
+      _boundingSphere = Sphere(p, 0.0f);
+      return;
+    }
+    _boundingBox.expandToInclude(p);
+    Point &c = _boundingSphere.center;
+    float &r = _boundingSphere.radius;
+    float d = Point::distance(p, c);
+    if (d <= r)
+      return;
+    float nuevo = (r + d) / 2.0f;
+    c += (p - c) * ((nuevo - r) / d);
+    // Holgura relativa para el redondeo al mover el centro
+    r = nuevo * (1.0f + 1e-5f);
+  }
+
   Sphere esferaPuntos(const vector<Point *> &pts) {
     if (pts.empty()) {
       return Sphere();
@@ -88,15 +206,15 @@ public:
     }
     c /= static_cast<float>(pts.size());
 
-    float r = 0.0f;
+    float r2 = 0.0f;
     i = 0;
     while (i < pts.size()) {
-      float d = Point::distance(c, *pts[i]);
-      r = max(r, d);
+      float d2 = Point::squaredDistance(c, *pts[i]);
+      r2 = max(r2, d2);
       i++;
     }
 
-    return Sphere(c, r);
+    return Sphere(c, sqrt(r2));
   }
 
   Sphere esferaHijos(const vector<SRNode *> &hijos) {
@@ -124,10 +242,92 @@ public:
     return Sphere(centro, radio);
   }
 
-  SRNode *insert(Point &data, size_t maxEntries) {
+  // Division del SR-tree por varianza: las entradas (puntos con radio 0 o
+  // esferas de los hijos) se ordenan por la dimension en que sus centros
+  // varian mas y se corta donde las esferas de ambos grupos se solapan
+  // menos, dejando al menos el 40% de las entradas de cada lado. A igual
+  // solape gana la menor suma de radios. Devuelve el orden; las primeras
+  // `corte` entradas quedan en el nodo y el resto va al hermano.
+  static vector<size_t> dividirPorVarianza(const vector<Sphere> &entradas,
+                                           size_t &corte) {
+    const size_t n = entradas.size();
+    Point media;
+    for (const Sphere &e : entradas)
+      media += e.center;
+    media /= static_cast<float>(n);
+
+    size_t eje = 0;
+    float mayorVar = -1.0f;
+    for (size_t d = 0; d < DIM; ++d) {
+      float var = 0.0f;
+      for (const Sphere &e : entradas) {
+        float diff = e.center[d] - media[d];
+        var += diff * diff;
+      }
+      if (var > mayorVar) {
+        mayorVar = var;
+        eje = d;
+      }
+    }
+
+    vector<size_t> orden(n);
+    for (size_t i = 0; i < n; ++i)
+      orden[i] = i;
+    sort(orden.begin(), orden.end(), [&](size_t a, size_t b) {
+      return entradas[a].center[eje] < entradas[b].center[eje];
+    });
+
+    const size_t minimo = max<size_t>(1, n * 2 / 5);
+    corte = n / 2;
+    float mejorSolape = numeric_limits<float>::max();
+    float mejorRadios = numeric_limits<float>::max();
+    for (size_t k = minimo; k + minimo <= n; ++k) {
+      Sphere a = esferaGrupo(entradas, orden, 0, k);
+      Sphere b = esferaGrupo(entradas, orden, k, n);
+      float radios = a.radius + b.radius;
+      float solape =
+          max(0.0f, radios - Point::distance(a.center, b.center));
+      if (solape < mejorSolape ||
+          (solape == mejorSolape && radios < mejorRadios)) {
+        mejorSolape = solape;
+        mejorRadios = radios;
+        corte = k;
+      }
+    }
+    return orden;
+  }
+
+  // Esfera centrada en el promedio de los centros de entradas[orden[lo..hi)]
+  static Sphere esferaGrupo(const vector<Sphere> &entradas,
+                            const vector<size_t> &orden, size_t lo,
+                            size_t hi) {
+    Point centro;
+    for (size_t i = lo; i < hi; ++i)
+      centro += entradas[orden[i]].center;
+    centro /= static_cast<float>(hi - lo);
+    float radio = 0.0f;
+    for (size_t i = lo; i < hi; ++i) {
+      const Sphere &e = entradas[orden[i]];
+      radio = max(radio, Point::distance(centro, e.center) + e.radius);
+    }
+    return Sphere(centro, radio);
+  }
+
+  // completo es la direccion del punto que guarda el arbol cuando las hojas
+  // tienen codigos; sin codigos la hoja lo copia a su bloque y no se usa
+  SRNode *insert(const Point &data, size_t maxEntries,
+                 Point *completo = nullptr) {
     if (_isLeaf) {
-      _points.push_back(&data);
-      actualizarVolumenes();
+      // Crece de a 50% hasta maxEntries + 1 filas en lugar de reservarlas
+      // todas: el bloque es la unica copia de los puntos
+      if (_block.size() == _block.capacity())
+        _block.reserve(min(maxEntries + 1,
+                           _block.capacity() +
+                               max<size_t>(2, _block.capacity() / 2)));
+      _points.push_back(completo);
+      _block.push(data);
+      enlazarFilas();
+      expandirVolumenes(data);
 
       if (_points.size() > maxEntries) {
         vector<Point *> todos = _points;
@@ -136,50 +336,30 @@ public:
           return nullptr;
         }
 
-        SRNode *hermano = new SRNode();
+        vector<Sphere> entradas;
+        for (Point *p : todos)
+          entradas.push_back(Sphere(*p, 0.0f));
+        size_t corte;
+        vector<size_t> orden = dividirPorVarianza(entradas, corte);
+
+        // Sin codigos todos apunta al bloque actual: se reparte a bloques
+        // nuevos del tamano justo y recien despues se suelta
+        SRNode *hermano = new SRNode(_block.dimBlock(), _block.codec());
         hermano->_isLeaf = true;
         hermano->_parent = _parent;
+        hermano->_block.reserve(orden.size() - corte);
+        LeafBlock propio(_block.dimBlock(), _block.codec());
+        propio.reserve(corte);
 
         _points.clear();
-
-        float maxD = 0.0f;
-        size_t s1 = 0, s2 = 1;
-
-        size_t i = 0;
-        while (i < todos.size()) {
-          size_t j = i + 1;
-          while (j < todos.size()) {
-            float d = Point::distance(*todos[i], *todos[j]);
-            if (d > maxD) {
-              maxD = d;
-              s1 = i;
-              s2 = j;
-            }
-            j++;
-          }
-          i++;
-        }
-
-        _points.push_back(todos[s1]);
-        hermano->_points.push_back(todos[s2]);
-
-        i = 0;
-        while (i < todos.size()) {
-          if (i == s1 || i == s2) {
-            i++;
-            continue;
-          }
-
-          float d1 = Point::distance(*todos[i], *todos[s1]);
-          float d2 = Point::distance(*todos[i], *todos[s2]);
-
-          if (d1 < d2) {
-            _points.push_back(todos[i]);
-          } else {
-            hermano->_points.push_back(todos[i]);
-          }
-          i++;
+        for (size_t i = 0; i < orden.size(); ++i) {
+          SRNode *destino = i < corte ? this : hermano;
+          destino->_points.push_back(todos[orden[i]]);
+          (i < corte ? propio : hermano->_block).push(*todos[orden[i]]);
         }
+        _block = std::move(propio);
+        enlazarFilas();
+        hermano->enlazarFilas();
 
         actualizarVolumenes();
         hermano->actualizarVolumenes();
@@ -205,9 +385,11 @@ public:
         }
       }
 
-      SRNode *split = mejor->insert(data, maxEntries);
-      actualizarVolumenes();
+      SRNode *split = mejor->insert(data, maxEntries, completo);
+      expandirVolumenes(data);
 
+      // Si el hijo se dividio sus volumenes son exactos: se ajustan los de
+      // este nodo a partir de ellos
       if (split != nullptr) {
         _children.push_back(split);
         split->_parent = this;
@@ -224,18 +406,16 @@ public:
         hermano->_isLeaf = false;
         hermano->_parent = _parent;
 
-        size_t mid = todosHijos.size() / 2;
+        vector<Sphere> entradas;
+        for (SRNode *h : todosHijos)
+          entradas.push_back(h->_boundingSphere);
+        size_t corte;
+        vector<size_t> orden = dividirPorVarianza(entradas, corte);
 
-        size_t i = 0;
-        while (i < mid) {
-          _children.push_back(todosHijos[i]);
-          i++;
-        }
-
-        while (i < todosHijos.size()) {
-          hermano->_children.push_back(todosHijos[i]);
-          todosHijos[i]->_parent = hermano;
-          i++;
+        for (size_t i = 0; i < orden.size(); ++i) {
+          SRNode *destino = i < corte ? this : hermano;
+          destino->_children.push_back(todosHijos[orden[i]]);
+          todosHijos[orden[i]]->_parent = destino;
         }
 
         actualizarVolumenes();
@@ -251,35 +431,561 @@ public:
 class SRTree {
 private:
   SRNode *_root;
+  // Aristas de la raiz a las hojas; cambia solo al dividir la raiz y en
+  // bulkLoad
+  size_t _height;
   size_t _maxEntries;
+  // Bloques de dimensiones de las hojas (ver LeafBlock); 0 = sin abandono
+  size_t _dimBlock;
+  // Puntos completos de las hojas con codigos que no estan en _vectors;
+  // deque mantiene sus direcciones. Sin codigos las hojas guardan los
+  // puntos en sus bloques y queda vacio.
+  deque<Point> _storage;
+  // Codec de las hojas tras quantize (nullptr = floats)
+  unique_ptr<Quantizer> _quantizer;
+  // Puntos movidos a disco por quantize
+  VectorFile _vectors;
+  // kNN cuantizado junta k * _rerank candidatos antes de medir exacto
+  size_t _rerank;
+  // Consultas kNN seguidas en que el MINDIST de las cajas no descarto
+  // ningun hijo, y total de consultas kNN (ver kNearestNeighbors)
+  mutable atomic<uint32_t> _cajaSinPoda{0};
+  mutable atomic<uint32_t> _consultasKnn{0};
 
 public:
-  SRTree() : _maxEntries(15), _root(nullptr) {}
-  explicit SRTree(size_t maxEntries)
-      : _maxEntries(maxEntries), _root(nullptr) {}
+  SRTree()
+      : _root(nullptr), _height(0), _maxEntries(15), _dimBlock(0),
+        _rerank(4) {}
+  explicit SRTree(size_t maxEntries, size_t dimBlock = 0)
+      : _root(nullptr), _height(0), _maxEntries(maxEntries),
+        _dimBlock(dimBlock), _rerank(4) {
+    LeafBlock::checkDimBlock(dimBlock);
+  }
+  ~SRTree() {
+    if (_root)
+      liberar(_root);
+  }
 
-  SRNode *getRoot() const { return _root; }
+  // Los nodos apuntan a _storage y a _quantizer: copiar el arbol dejaria
+  // dos duenos de los mismos nodos. Mover conserva ambas direcciones.
+  SRTree(const SRTree &) = delete;
+  SRTree &operator=(const SRTree &) = delete;
+  SRTree(SRTree &&other) noexcept
+      : _root(exchange(other._root, nullptr)),
+        _height(exchange(other._height, 0)), _maxEntries(other._maxEntries),
+        _dimBlock(other._dimBlock), _storage(std::move(other._storage)),
+        _quantizer(std::move(other._quantizer)),
+        _vectors(std::move(other._vectors)), _rerank(other._rerank) {}
+  SRTree &operator=(SRTree &&other) noexcept {
+    if (this != &other) {
+      if (_root)
+        liberar(_root);
+      _root = exchange(other._root, nullptr);
+      _height = exchange(other._height, 0);
+      _maxEntries = other._maxEntries;
+      _dimBlock = other._dimBlock;
+      _storage = std::move(other._storage);
+      _quantizer = std::move(other._quantizer);
+      _vectors = std::move(other._vectors);
+      _rerank = other._rerank;
+    }
+    return *this;
+  }
 
+  SRNode *getRoot() const { return _root; }
+  const Quantizer *getQuantizer() const { return _quantizer.get(); }
+  const VectorFile &getVectorFile() const { return _vectors; }
+  void setRerank(size_t factor) { _rerank = max<size_t>(1, factor); }
+
+  // Pasa las hojas a codigos Float16 o Int8 (Float32 vuelve a floats). Con
+  // vectorFile los puntos completos se escriben ahi y se leen por mmap, y
+  // se liberan las copias en memoria; sin el quedan en memoria. Los puntos
+  // insertados despues quedan en memoria hasta el siguiente quantize. Con
+  // Float32 los puntos vuelven a los bloques de las hojas y vectorFile no
+  // se usa.
+  void quantize(Codec codec, const string &vectorFile = "");
+
+  // Carga masiva de abajo hacia arriba: las hojas salen de ordenar los
+  // puntos con Sort-Tile-Recursive sobre los ejes principales y cada nivel
+  // superior repite el empaquetado con los centros de sus hijos, asi todas
+  // las hojas quedan a la misma profundidad. Si ya habia datos se
+  // reconstruye con todos y los Point* devueltos antes dejan de ser validos.
+  void bulkLoad(vector<Point> points, size_t threads = 0);
+
+  // Los Point* que devuelven las consultas apuntan a las filas de las hojas
+  // (o al punto completo si hay codigos) y valen hasta la siguiente
+  // insercion, bulkLoad o quantize.
   void insert(const Point &point);
   bool search(const Point &point) const;
   vector<Point *> rangeQuery(const MBB &box) const;
-  vector<Point *> rangeQuery(const Sphere &sphere) const;
+  vector<Point *> rangeQuery(const Sphere &sphere,
+                             SRQueryStats *stats = nullptr) const;
+
+  // Aristas de la raiz a las hojas (todas estan a la misma profundidad)
+  size_t height() const { return _height; }
+
+  // Consultas por rango en profundidad que entregan cada punto a
+  // visit(Point *) en lugar de juntarlos en un vector. Si visit devuelve
+  // bool, false detiene el recorrido.
+  template <class Visitor>
+  void rangeQueryEach(const MBB &box, Visitor &&visit,
+                      SRQueryStats *stats = nullptr) const;
+  template <class Visitor>
+  void rangeQueryEach(const Sphere &sphere, Visitor &&visit,
+                      SRQueryStats *stats = nullptr) const;
+
+  vector<Point *> kNearestNeighbors(const Point &point, size_t k,
+                                    SRQueryStats *stats = nullptr) const;
+
+private:
+  // Ejes principales usados por STR
+  static constexpr size_t kEjesSTR = 3;
+
+  template <class F>
+  static void parallelFor(size_t n, size_t threads, F &&fn) {
+    if (threads <= 1 || n < 2 * threads) {
+      for (size_t i = 0; i < n; ++i)
+        fn(i);
+      return;
+    }
+    vector<thread> workers;
+    size_t chunk = (n + threads - 1) / threads;
+    for (size_t t = 0; t < threads; ++t) {
+      size_t lo = t * chunk;
+      size_t hi = min(n, lo + chunk);
+      if (lo >= hi)
+        break;
+      workers.emplace_back([&fn, lo, hi]() {
+        for (size_t i = lo; i < hi; ++i)
+          fn(i);
+      });
+    }
+    for (thread &w : workers)
+      w.join();
+  }
+
+  static float producto(const Point &a, const Point &b) {
+    float sum = 0.0f;
+    for (size_t d = 0; d < DIM; ++d)
+      sum += a[d] * b[d];
+    return sum;
+  }
 
-  vector<Point *> kNearestNeighbors(const Point &point, size_t k) const;
+  static vector<Point> ejesPrincipales(const vector<Point *> &pts,
+                                       size_t count);
+  static void ordenarPorEje(vector<size_t> &idx, size_t lo, size_t hi,
+                            const vector<float> &proy, size_t ejes,
+                            size_t eje, size_t threads);
+  static vector<pair<size_t, size_t>>
+  empaquetarSTR(vector<size_t> &idx, const vector<float> &proy, size_t ejes,
+                size_t porGrupo, size_t threads);
+  // Borra nodo y todo su subarbol; la usan el destructor y bulkLoad al
+  // reemplazar la raiz
+  static void liberar(SRNode *nodo);
+
+  // Cada nivel deja a lo mas un nodo por desapilar por hijo de su padre
+  size_t capacidadPila() const {
+    return 1 + _height * max<size_t>(2, _maxEntries);
+  }
+
+  template <class Visitor> static bool emitir(Visitor &visit, Point *p) {
+    if constexpr (is_same<decltype(visit(p)), bool>::value) {
+      return visit(p);
+    } else {
+      visit(p);
+      return true;
+    }
+  }
 };
 
+template <class Visitor>
+void SRTree::rangeQueryEach(const MBB &box, Visitor &&visit,
+                            SRQueryStats *stats) const {
+  if (_root == nullptr)
+    return;
+  SRQueryStats localStats;
+  SRQueryStats &st = stats ? *stats : localStats;
+
+  NodeStack pila(capacidadPila());
+  pila.push(_root);
+
+  while (!pila.empty()) {
+    SRNode *actual = pila.pop();
+
+    bool inter = true;
+    size_t i = 0;
+    while (i < DIM && inter) {
+      if (actual->getBoundingBox().maxCorner[i] < box.minCorner[i] ||
+          actual->getBoundingBox().minCorner[i] > box.maxCorner[i]) {
+        inter = false;
+      }
+      i++;
+    }
+
+    if (!inter)
+      continue;
+    st.nodesVisited++;
+
+    if (actual->getIsLeaf()) {
+      for (Point *p : actual->getPoints()) {
+        bool dentro = true;
+        i = 0;
+        while (i < DIM && dentro) {
+          if ((*p)[i] < box.minCorner[i] || (*p)[i] > box.maxCorner[i]) {
+            dentro = false;
+          }
+          i++;
+        }
+        if (dentro && !emitir(visit, p)) {
+          return;
+        }
+      }
+    } else {
+      for (SRNode *hijo : actual->getChildren()) {
+        pila.push(hijo);
+      }
+    }
+  }
+}
+
+template <class Visitor>
+void SRTree::rangeQueryEach(const Sphere &sphere, Visitor &&visit,
+                            SRQueryStats *stats) const {
+  if (_root == nullptr)
+    return;
+  SRQueryStats localStats;
+  SRQueryStats &st = stats ? *stats : localStats;
+
+  NodeStack pila(capacidadPila());
+  pila.push(_root);
+
+  while (!pila.empty()) {
+    SRNode *actual = pila.pop();
+
+    // El nodo queda fuera si la consulta no toca su esfera o su caja. La
+    // holgura cubre el redondeo de MINDIST, que suma en otro orden que las
+    // distancias a los puntos
+    float d =
+        Point::distance(sphere.center, actual->getBoundingSphere().center);
+    st.distanceComputations++;
+    if (d > sphere.radius + actual->getBoundingSphere().radius ||
+        MBB::minDist(sphere.center, actual->getBoundingBox()) >
+            sphere.radius * (1.0f + 1e-5f)) {
+      continue;
+    }
+    st.nodesVisited++;
+
+    if (actual->getIsLeaf()) {
+      // Cerca del borde el redondeo de radius * radius, y por bloques el
+      // orden de la suma, pueden dejar fuera un punto que Point::distance
+      // pone dentro (o al reves); en esa franja decide el punto real
+      const float r2 = sphere.radius * sphere.radius;
+      const float seguro = r2 * (1.0f - 1e-4f);
+      const float limite = r2 * (1.0f + 1e-4f);
+      const LeafBlock &block = actual->getBlock();
+      st.distanceComputations += block.size();
+      FixedBuffer<float, 64> dists(block.size());
+      block.squaredDistances(sphere.center.data(), dists.data(), limite);
+      for (size_t i = 0; i < block.size(); ++i) {
+        Point *p = actual->getPoints()[i];
+        float d = dists[i];
+        // Desigualdad triangular: |d(q,x) - d(q,x')| <= error(i). Si ni
+        // restando el error entra al radio se descarta sin leer el punto
+        if (block.quantized()) {
+          if (sqrt(d) - block.error(i) > sphere.radius * (1.0f + 1e-5f))
+            continue;
+          d = Point::squaredDistance(sphere.center, *p);
+        }
+        bool dentro =
+            d <= seguro ||
+            (d <= limite &&
+             Point::distance(sphere.center, *p) <= sphere.radius);
+        if (dentro && !emitir(visit, p)) {
+          return;
+        }
+      }
+    } else {
+      for (SRNode *hijo : actual->getChildren()) {
+        pila.push(hijo);
+      }
+    }
+  }
+}
+
+void SRTree::quantize(Codec codec, const string &vectorFile) {
+  if (_dimBlock && codec != Codec::Float32)
+    throw invalid_argument(
+        "SRTree: quantize no admite bloques de dimensiones");
+
+  vector<SRNode *> hojas;
+  vector<SRNode *> pila;
+  if (_root)
+    pila.push_back(_root);
+  while (!pila.empty()) {
+    SRNode *nodo = pila.back();
+    pila.pop_back();
+    if (nodo->getIsLeaf())
+      hojas.push_back(nodo);
+    for (SRNode *hijo : nodo->getChildren())
+      pila.push_back(hijo);
+  }
+
+  vector<const Point *> todos;
+  for (SRNode *hoja : hojas)
+    todos.insert(todos.end(), hoja->getPoints().begin(),
+                 hoja->getPoints().end());
+
+  unique_ptr<Quantizer> codigo;
+  if (codec != Codec::Float32)
+    codigo.reset(new Quantizer(codec, todos));
+
+  // Con codigos los puntos completos salen de los bloques antes de
+  // reemplazarlos: al archivo o, sin el, a copias en memoria
+  VectorFile archivo;
+  if (codigo && !vectorFile.empty())
+    archivo = VectorFile(vectorFile, todos);
+  const bool copiar = codigo && !archivo.size() && !_quantizer;
+  deque<Point> copias;
+
+  size_t fila = 0;
+  for (SRNode *hoja : hojas) {
+    vector<Point *> puntos = hoja->getPoints();
+    for (Point *&p : puntos) {
+      if (archivo.size()) {
+        p = archivo.at(fila++);
+      } else if (copiar) {
+        copias.push_back(*p);
+        p = &copias.back();
+      }
+    }
+    hoja->setPoints(puntos, codigo.get());
+  }
+
+  _quantizer = std::move(codigo);
+  if (archivo.size() || !_quantizer) {
+    _vectors = std::move(archivo);
+    _storage.clear();
+    _storage.shrink_to_fit();
+  } else if (copiar) {
+    _storage.swap(copias);
+  }
+}
+
+// Iteracion de potencia con deflacion sobre una muestra centrada de hasta
+// 1024 puntos
+vector<Point> SRTree::ejesPrincipales(const vector<Point *> &pts,
+                                      size_t count) {
+  vector<Point> muestra;
+  size_t paso = max<size_t>(1, pts.size() / 1024);
+  for (size_t i = 0; i < pts.size(); i += paso)
+    muestra.push_back(*pts[i]);
+  Point media;
+  for (const Point &p : muestra)
+    media += p;
+  media /= static_cast<float>(muestra.size());
+  for (Point &p : muestra)
+    p -= media;
+
+  vector<Point> ejes;
+  mt19937 gen(12345);
+  normal_distribution<float> normal(0.0f, 1.0f);
+  while (ejes.size() < count) {
+    Point v;
+    for (size_t d = 0; d < DIM; ++d)
+      v[d] = normal(gen);
+    v /= v.norm();
+    for (int it = 0; it < 30; ++it) {
+      Point w;
+      for (const Point &x : muestra)
+        w += x * producto(x, v);
+      for (const Point &u : ejes)
+        w -= u * producto(w, u);
+      float n = w.norm();
+      if (n <= 0.0f)
+        break;
+      v = w / n;
+    }
+    ejes.push_back(v);
+  }
+  return ejes;
+}
+
+// Ordena idx[lo, hi) por la proyeccion en eje: trozos ordenados en paralelo
+// y luego mezclados de a pares
+void SRTree::ordenarPorEje(vector<size_t> &idx, size_t lo, size_t hi,
+                           const vector<float> &proy, size_t ejes, size_t eje,
+                           size_t threads) {
+  auto menor = [&](size_t a, size_t b) {
+    return proy[a * ejes + eje] < proy[b * ejes + eje];
+  };
+  size_t trozos = max<size_t>(1, min(threads, (hi - lo) / 4096));
+  size_t largo = (hi - lo + trozos - 1) / trozos;
+  auto inicio = [&](size_t t) { return min(hi, lo + t * largo); };
+  parallelFor(trozos, trozos, [&](size_t t) {
+    sort(idx.begin() + inicio(t), idx.begin() + inicio(t + 1), menor);
+  });
+  for (size_t ancho = 1; ancho < trozos; ancho *= 2) {
+    size_t pares = (trozos + 2 * ancho - 1) / (2 * ancho);
+    parallelFor(pares, pares, [&](size_t p) {
+      size_t a = 2 * ancho * p;
+      inplace_merge(idx.begin() + inicio(a), idx.begin() + inicio(a + ancho),
+                    idx.begin() + inicio(a + 2 * ancho), menor);
+    });
+  }
+}
+
+// Sort-Tile-Recursive: con g grupos por formar y e ejes restantes, ordena
+// por el eje actual y corta en ceil(g^(1/e)) tiras, que se tratan igual con
+// el siguiente eje; en el ultimo eje se corta cada tira en grupos de
+// porGrupo. Devuelve los grupos como rangos de idx.
+vector<pair<size_t, size_t>>
+SRTree::empaquetarSTR(vector<size_t> &idx, const vector<float> &proy,
+                      size_t ejes, size_t porGrupo, size_t threads) {
+  vector<pair<size_t, size_t>> rangos = {{0, idx.size()}};
+  for (size_t eje = 0; eje < ejes; ++eje) {
+    if (rangos.size() == 1) {
+      ordenarPorEje(idx, 0, idx.size(), proy, ejes, eje, threads);
+    } else {
+      parallelFor(rangos.size(), threads, [&](size_t r) {
+        ordenarPorEje(idx, rangos[r].first, rangos[r].second, proy, ejes, eje,
+                      1);
+      });
+    }
+    if (eje + 1 == ejes)
+      break;
+
+    vector<pair<size_t, size_t>> tiras;
+    for (const auto &rango : rangos) {
+      size_t grupos = (rango.second - rango.first + porGrupo - 1) / porGrupo;
+      size_t cortes = 1;
+      while (pow(double(cortes), double(ejes - eje)) < double(grupos))
+        cortes++;
+      size_t largo = (grupos + cortes - 1) / cortes * porGrupo;
+      for (size_t s = rango.first; s < rango.second; s += largo)
+        tiras.push_back({s, min(rango.second, s + largo)});
+    }
+    rangos.swap(tiras);
+  }
+
+  vector<pair<size_t, size_t>> grupos;
+  for (const auto &rango : rangos)
+    for (size_t s = rango.first; s < rango.second; s += porGrupo)
+      grupos.push_back({s, min(rango.second, s + porGrupo)});
+  return grupos;
+}
+
+void SRTree::liberar(SRNode *nodo) {
+  for (SRNode *hijo : nodo->getChildren())
+    liberar(hijo);
+  delete nodo;
+}
+
+void SRTree::bulkLoad(vector<Point> points, size_t threads) {
+  if (threads == 0)
+    threads = max<size_t>(1, thread::hardware_concurrency());
+
+  deque<Point> datos;
+  if (_root) {
+    vector<SRNode *> pila = {_root};
+    while (!pila.empty()) {
+      SRNode *nodo = pila.back();
+      pila.pop_back();
+      for (Point *p : nodo->getPoints())
+        datos.push_back(*p);
+      for (SRNode *hijo : nodo->getChildren())
+        pila.push_back(hijo);
+    }
+    liberar(_root);
+    _root = nullptr;
+    _height = 0;
+  }
+  _storage.clear();
+  _vectors = VectorFile();
+  for (Point &p : points)
+    datos.push_back(p);
+  if (datos.empty())
+    return;
+
+  vector<Point *> pts;
+  for (Point &p : datos)
+    pts.push_back(&p);
+  const size_t porNodo = max<size_t>(2, _maxEntries);
+  const vector<Point> ejes = ejesPrincipales(pts, kEjesSTR);
+  const size_t E = ejes.size();
+
+  vector<float> proy(pts.size() * E);
+  parallelFor(pts.size(), threads, [&](size_t i) {
+    for (size_t e = 0; e < E; ++e)
+      proy[i * E + e] = producto(*pts[i], ejes[e]);
+  });
+  vector<size_t> orden(pts.size());
+  iota(orden.begin(), orden.end(), size_t(0));
+  vector<pair<size_t, size_t>> grupos =
+      empaquetarSTR(orden, proy, E, porNodo, threads);
+
+  vector<SRNode *> nivel(grupos.size());
+  parallelFor(grupos.size(), threads, [&](size_t g) {
+    vector<Point *> hoja;
+    for (size_t k = grupos[g].first; k < grupos[g].second; ++k)
+      hoja.push_back(pts[orden[k]]);
+    SRNode *nodo = new SRNode(_dimBlock, _quantizer.get());
+    nodo->setPoints(hoja, _quantizer.get());
+    nodo->actualizarVolumenes();
+    nivel[g] = nodo;
+  });
+
+  while (nivel.size() > 1) {
+    proy.assign(nivel.size() * E, 0.0f);
+    parallelFor(nivel.size(), threads, [&](size_t n) {
+      for (size_t e = 0; e < E; ++e)
+        proy[n * E + e] =
+            producto(nivel[n]->getBoundingSphere().center, ejes[e]);
+    });
+    orden.resize(nivel.size());
+    iota(orden.begin(), orden.end(), size_t(0));
+    grupos = empaquetarSTR(orden, proy, E, porNodo, threads);
+
+    vector<SRNode *> siguiente(grupos.size());
+    parallelFor(grupos.size(), threads, [&](size_t g) {
+      SRNode *nodo = new SRNode();
+      nodo->setIsLeaf(false);
+      vector<SRNode *> hijos;
+      for (size_t k = grupos[g].first; k < grupos[g].second; ++k) {
+        hijos.push_back(nivel[orden[k]]);
+        hijos.back()->setParent(nodo);
+      }
+      nodo->setChildren(hijos);
+      nodo->actualizarVolumenes();
+      siguiente[g] = nodo;
+    });
+    nivel.swap(siguiente);
+    _height++;
+  }
+
+  _root = nivel[0];
+  _root->setParent(nullptr);
+  // Sin codigos las hojas ya copiaron los puntos a sus bloques
+  if (_quantizer)
+    _storage.swap(datos);
+}
+
 void SRTree::insert(const Point &point) {
-  Point *nuevoPt = new Point(point);
+  // Con codigos la hoja no guarda el punto completo
+  Point *completo = nullptr;
+  if (_quantizer) {
+    _storage.push_back(point);
+    completo = &_storage.back();
+  }
 
   if (_root == nullptr) {
-    _root = new SRNode();
+    _root = new SRNode(_dimBlock, _quantizer.get());
     _root->setIsLeaf(true);
     _root->setParent(nullptr);
-    _root->insert(*nuevoPt, _maxEntries);
+    _root->insert(point, _maxEntries, completo);
     return;
   }
 
-  SRNode *split = _root->insert(*nuevoPt, _maxEntries);
+  SRNode *split = _root->insert(point, _maxEntries, completo);
 
   if (split != nullptr) {
     SRNode *nuevaRaiz = new SRNode();
@@ -295,6 +1001,7 @@ void SRTree::insert(const Point &point) {
 
     nuevaRaiz->actualizarVolumenes();
     _root = nuevaRaiz;
+    _height++;
   }
 }
 
@@ -302,16 +1009,26 @@ bool SRTree::search(const Point &point) const {
   if (_root == nullptr)
     return false;
 
-  queue<SRNode *> q;
-  q.push(_root);
+  NodeStack pila(capacidadPila());
+  pila.push(_root);
 
-  while (!q.empty()) {
-    SRNode *actual = q.front();
-    q.pop();
+  while (!pila.empty()) {
+    SRNode *actual = pila.pop();
 
     if (actual->getIsLeaf()) {
-      for (Point *p : actual->getPoints()) {
-        if (Point::distance(*p, point) < EPSILON) {
+      const LeafBlock &block = actual->getBlock();
+      FixedBuffer<float, 64> dists(block.size());
+      block.squaredDistances(point.data(), dists.data(), EPSILON * EPSILON);
+      for (size_t i = 0; i < block.size(); ++i) {
+        float d = dists[i];
+        // Con codigos la distancia aproximada solo descarta; se confirma
+        // contra el punto completo
+        if (block.quantized()) {
+          if (sqrt(d) > block.error(i) + EPSILON)
+            continue;
+          d = Point::squaredDistance(point, *actual->getPoints()[i]);
+        }
+        if (d < EPSILON * EPSILON) {
           return true;
         }
       }
@@ -332,7 +1049,7 @@ bool SRTree::search(const Point &point) const {
         }
 
         if (e || c) {
-          q.push(hijo);
+          pila.push(hijo);
         }
       }
     }
@@ -342,89 +1059,24 @@ bool SRTree::search(const Point &point) const {
 
 vector<Point *> SRTree::rangeQuery(const MBB &box) const {
   vector<Point *> res;
-  if (_root == nullptr)
-    return res;
-
-  queue<SRNode *> q;
-  q.push(_root);
-
-  while (!q.empty()) {
-    SRNode *actual = q.front();
-    q.pop();
-
-    bool inter = true;
-    size_t i = 0;
-    while (i < DIM && inter) {
-      if (actual->getBoundingBox().maxCorner[i] < box.minCorner[i] ||
-          actual->getBoundingBox().minCorner[i] > box.maxCorner[i]) {
-        inter = false;
-      }
-      i++;
-    }
-
-    if (!inter)
-      continue;
-
-    if (actual->getIsLeaf()) {
-      for (Point *p : actual->getPoints()) {
-        bool dentro = true;
-        i = 0;
-        while (i < DIM && dentro) {
-          if ((*p)[i] < box.minCorner[i] || (*p)[i] > box.maxCorner[i]) {
-            dentro = false;
-          }
-          i++;
-        }
-        if (dentro) {
-          res.push_back(p);
-        }
-      }
-    } else {
-      for (SRNode *hijo : actual->getChildren()) {
-        q.push(hijo);
-      }
-    }
-  }
+  rangeQueryEach(box, [&res](Point *p) { res.push_back(p); });
   return res;
 }
 
-vector<Point *> SRTree::rangeQuery(const Sphere &sphere) const {
+vector<Point *> SRTree::rangeQuery(const Sphere &sphere,
+                                   SRQueryStats *stats) const {
   vector<Point *> res;
-  if (_root == nullptr)
-    return res;
-
-  queue<SRNode *> q;
-  q.push(_root);
-
-  while (!q.empty()) {
-    SRNode *actual = q.front();
-    q.pop();
-
-    float d =
-        Point::distance(sphere.center, actual->getBoundingSphere().center);
-    if (d > sphere.radius + actual->getBoundingSphere().radius) {
-      continue;
-    }
-
-    if (actual->getIsLeaf()) {
-      for (Point *p : actual->getPoints()) {
-        if (Point::distance(*p, sphere.center) <= sphere.radius) {
-          res.push_back(p);
-        }
-      }
-    } else {
-      for (SRNode *hijo : actual->getChildren()) {
-        q.push(hijo);
-      }
-    }
-  }
+  rangeQueryEach(sphere, [&res](Point *p) { res.push_back(p); }, stats);
   return res;
 }
 
-vector<Point *> SRTree::kNearestNeighbors(const Point &point, size_t k) const {
+vector<Point *> SRTree::kNearestNeighbors(const Point &point, size_t k,
+                                          SRQueryStats *stats) const {
   vector<Point *> res;
   if (_root == nullptr || k == 0)
     return res;
+  SRQueryStats localStats;
+  SRQueryStats &st = stats ? *stats : localStats;
 
   auto cmp = [&point](const pair<float, Point *> &a,
                       const pair<float, Point *> &b) {
@@ -445,6 +1097,21 @@ vector<Point *> SRTree::kNearestNeighbors(const Point &point, size_t k) const {
       nq(nodeCmp);
 
   nq.push({0.0f, _root});
+  vector<float> dists;
+  vector<float> cotas;
+  // La caja ayuda en datos agrupados pero en uniformes de alta dimension
+  // sus cotas quedan muy por debajo de la distancia al k-esimo vecino y no
+  // podan nada. Tras kCajaSinPoda consultas seguidas sin podas el arbol deja
+  // de medirla y solo la prueba una de cada kSondeoCaja consultas.
+  constexpr uint32_t kCajaSinPoda = 8, kSondeoCaja = 16;
+  const bool usarCaja =
+      _cajaSinPoda.load(memory_order_relaxed) < kCajaSinPoda ||
+      _consultasKnn.fetch_add(1, memory_order_relaxed) % kSondeoCaja == 0;
+  size_t podasCaja = 0;
+  // Con codigos pq guarda k * _rerank candidatos por distancia aproximada
+  const size_t keep = k;
+  if (_quantizer)
+    k *= _rerank;
 
   while (!nq.empty() && res.size() < k) {
     pair<float, SRNode *> top = nq.top();
@@ -452,13 +1119,22 @@ vector<Point *> SRTree::kNearestNeighbors(const Point &point, size_t k) const {
     SRNode *nodo = top.second;
     nq.pop();
 
-    if (pq.size() == k && minD > pq.top().first) {
+    // pq guarda distancias al cuadrado
+    if (pq.size() == k && minD * minD > pq.top().first) {
       break;
     }
+    st.nodesVisited++;
 
     if (nodo->getIsLeaf()) {
-      for (Point *p : nodo->getPoints()) {
-        float d = Point::distance(point, *p);
+      const LeafBlock &block = nodo->getBlock();
+      st.distanceComputations += block.size();
+      dists.resize(block.size());
+      block.squaredDistances(point.data(), dists.data(),
+                             pq.size() < k ? numeric_limits<float>::max()
+                                           : pq.top().first);
+      for (size_t i = 0; i < dists.size(); ++i) {
+        float d = dists[i];
+        Point *p = nodo->getPoints()[i];
         if (pq.size() < k) {
           pq.push({d, p});
         } else if (d < pq.top().first) {
@@ -467,23 +1143,78 @@ vector<Point *> SRTree::kNearestNeighbors(const Point &point, size_t k) const {
         }
       }
     } else {
-      for (SRNode *hijo : nodo->getChildren()) {
-        float d = Point::distance(point, hijo->getBoundingSphere().center);
-        float minD = max(0.0f, d - hijo->getBoundingSphere().radius);
-
-        if (pq.size() < k || minD < pq.top().first) {
-          nq.push({minD, hijo});
+      // Cota inferior de cada hijo: la mayor entre la de su esfera y el
+      // MINDIST de su caja. La caja solo se mide si la esfera no basta para
+      // descartarlo.
+      const vector<SRNode *> &hijos = nodo->getChildren();
+      st.distanceComputations += hijos.size();
+      cotas.clear();
+      float cotaSuperior = numeric_limits<float>::max();
+      size_t masCercano = 0;
+      for (size_t i = 0; i < hijos.size(); ++i) {
+        const Sphere &esfera = hijos[i]->getBoundingSphere();
+        float d = Point::distance(point, esfera.center);
+        float minD = max(0.0f, d - esfera.radius);
+        // Holgura por redondeo, como en rangeQueryEach
+        if (usarCaja && (pq.size() < k || minD * minD < pq.top().first)) {
+          float cajaD =
+              MBB::minDist(point, hijos[i]->getBoundingBox()) * (1.0f - 1e-5f);
+          if (pq.size() == k && cajaD * cajaD >= pq.top().first)
+            podasCaja++;
+          minD = max(minD, cajaD);
+        }
+        cotas.push_back(minD);
+        if (minD < cotas[masCercano])
+          masCercano = i;
+        // Con k = 1 el vecino esta a lo mas a d + r de cualquier hijo
+        if (k == 1)
+          cotaSuperior = min(cotaSuperior, d + esfera.radius);
+      }
+      // y a lo mas a MINMAXDIST del hijo mas prometedor, que tambien lee la
+      // caja
+      if (k == 1 && usarCaja)
+        cotaSuperior =
+            min(cotaSuperior,
+                MBB::minMaxDist(point, hijos[masCercano]->getBoundingBox()));
+
+      for (size_t i = 0; i < hijos.size(); ++i) {
+        float minD = cotas[i];
+        if (minD > cotaSuperior * (1.0f + 1e-5f))
+          continue;
+        if (pq.size() < k || minD * minD < pq.top().first) {
+          nq.push({minD, hijos[i]});
         }
       }
     }
   }
 
+  if (usarCaja) {
+    if (podasCaja)
+      _cajaSinPoda.store(0, memory_order_relaxed);
+    else
+      _cajaSinPoda.fetch_add(1, memory_order_relaxed);
+  }
+
   while (!pq.empty()) {
     res.push_back(pq.top().second);
     pq.pop();
   }
 
-  reverse(res.begin(), res.end());
+  if (!_quantizer) {
+    reverse(res.begin(), res.end());
+    return res;
+  }
+
+  // Re-ranking con los puntos completos
+  vector<pair<float, Point *>> exactos;
+  st.distanceComputations += res.size();
+  for (Point *p : res)
+    exactos.push_back({Point::squaredDistance(point, *p), p});
+  size_t n = min(keep, exactos.size());
+  partial_sort(exactos.begin(), exactos.begin() + n, exactos.end());
+  res.clear();
+  for (size_t i = 0; i < n; ++i)
+    res.push_back(exactos[i].second);
   return res;
 }
 
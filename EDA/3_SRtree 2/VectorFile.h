@@ -0,0 +1,85 @@
+#ifndef VECTOR_FILE_H
+#define VECTOR_FILE_H
+
+#include "Point.h"
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Vectores completos guardados en un archivo y leidos con mmap. Las hojas
+// cuantizadas solo tienen codigos; el re-ranking toca estas filas y el
+// sistema operativo carga a memoria solo las paginas que se usan. El mapeo
+// es privado: escribir por un Point* no modifica el archivo.
+class VectorFile {
+public:
+  VectorFile() : _points(nullptr), _size(0) {}
+
+  VectorFile(const std::string &path, const std::vector<const Point *> &pts)
+      : _points(nullptr), _size(pts.size()) {
+    std::FILE *out = std::fopen(path.c_str(), "wb");
+    if (!out)
+      throw std::runtime_error("VectorFile: no se pudo crear " + path);
+    bool ok = true;
+    for (const Point *p : pts)
+      ok = ok && std::fwrite(p->data(), sizeof(float), DIM, out) == DIM;
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok)
+      throw std::runtime_error("VectorFile: no se pudo escribir " + path);
+    if (_size == 0)
+      return;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("VectorFile: no se pudo abrir " + path);
+    void *map = ::mmap(nullptr, bytes(), PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                       fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      throw std::runtime_error("VectorFile: mmap fallo en " + path);
+    _points = static_cast<Point *>(map);
+  }
+
+  ~VectorFile() { release(); }
+
+  VectorFile(const VectorFile &) = delete;
+  VectorFile &operator=(const VectorFile &) = delete;
+  VectorFile(VectorFile &&other) noexcept
+      : _points(std::exchange(other._points, nullptr)),
+        _size(std::exchange(other._size, 0)) {}
+  VectorFile &operator=(VectorFile &&other) noexcept {
+    if (this != &other) {
+      release();
+      _points = std::exchange(other._points, nullptr);
+      _size = std::exchange(other._size, 0);
+    }
+    return *this;
+  }
+
+  std::size_t size() const { return _size; }
+  std::size_t bytes() const { return _size * sizeof(Point); }
+  Point *at(std::size_t i) const { return _points + i; }
+
+private:
+  // Point es solo un arreglo de DIM floats, asi que una fila del archivo
+  // tiene su misma representacion
+  static_assert(sizeof(Point) == DIM * sizeof(float),
+                "Point debe ser DIM floats contiguos");
+
+  Point *_points;
+  std::size_t _size;
+
+  void release() {
+    if (_points)
+      ::munmap(_points, bytes());
+    _points = nullptr;
+  }
+};
+
+#endif // VECTOR_FILE_H
@@ -0,0 +1,497 @@
+// Benchmarks del SR-tree.
+// Compilar: g++ -std=c++17 -O2 bench.cpp -o bench
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "L2Kernel.h"
+#include "LeafBlock.h"
+#include "Point.h"
+#include "Quantizer.h"
+#include "SRtree.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Bucle original de Point::distance, para comparar
+float referenceDistance(const float *a, const float *b) {
+  float sum = 0.0f;
+  for (std::size_t i = 0; i < DIM; ++i) {
+    float diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  return std::sqrt(sum);
+}
+
+// Nanosegundos por llamada de `kernel` sobre todos los pares (a[i], b[i])
+template <class Kernel>
+double nsPerCall(const std::vector<Point> &a, const std::vector<Point> &b,
+                 std::size_t rounds, Kernel kernel) {
+  float sink = 0.0f;
+  auto start = Clock::now();
+  for (std::size_t r = 0; r < rounds; ++r)
+    for (std::size_t i = 0; i < a.size(); ++i)
+      sink += kernel(a[i].data(), b[i].data());
+  auto end = Clock::now();
+  if (sink == 1.0f)
+    std::cout << "";
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  return ns / static_cast<double>(rounds * a.size());
+}
+
+// -------------------------------------------------------------
+// Nucleos L2: bucle original vs escalar vs AVX2 vs AVX-512
+// -------------------------------------------------------------
+// pairs chico: los vectores quedan en cache y se mide el calculo; grande:
+// se mide el ancho de banda de memoria
+void benchKernels(std::size_t pairs) {
+  const std::size_t rounds = 100000 / pairs;
+  std::vector<Point> a, b;
+  for (std::size_t i = 0; i < pairs; ++i) {
+    a.push_back(Point::random());
+    b.push_back(Point::random());
+  }
+
+  std::cout << "=== Distancia L2, DIM=" << DIM << ", " << pairs
+            << " pares (ns/llamada) ===\n";
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << std::setw(22) << "referencia (sqrt)" << std::setw(10)
+            << nsPerCall(a, b, rounds, referenceDistance) << '\n';
+  std::cout << std::setw(22) << "escalar^2" << std::setw(10)
+            << nsPerCall(a, b, rounds, [](const float *x, const float *y) {
+                 return l2::squaredScalar(x, y, DIM);
+               })
+            << '\n';
+#ifdef L2_KERNEL_X86
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    std::cout << std::setw(22) << "avx2+fma^2" << std::setw(10)
+              << nsPerCall(a, b, rounds, [](const float *x, const float *y) {
+                   return l2::squaredAvx2(x, y, DIM);
+                 })
+              << '\n';
+  if (__builtin_cpu_supports("avx512f"))
+    std::cout << std::setw(22) << "avx512^2" << std::setw(10)
+              << nsPerCall(a, b, rounds, [](const float *x, const float *y) {
+                   return l2::squaredAvx512(x, y, DIM);
+                 })
+              << '\n';
+#endif
+  std::cout << std::setw(22) << "Point::distance" << std::setw(10)
+            << nsPerCall(a, b, rounds,
+                         [](const float *x, const float *y) {
+                           return std::sqrt(l2::squared(x, y, DIM));
+                         })
+            << "   (" << l2::kernelName() << ")\n\n";
+}
+
+// -------------------------------------------------------------
+// Recorrido de hoja: punteros a Point sueltos vs bloque contiguo
+// -------------------------------------------------------------
+void benchLeafScan() {
+  const std::size_t leaves = 2000, perLeaf = 18, rounds = 5;
+  // Los Point se reservan intercalados con otras reservas y en orden
+  // aleatorio, como quedan tras muchas inserciones
+  std::vector<std::unique_ptr<Point>> owned;
+  std::vector<std::unique_ptr<char[]>> noise;
+  for (std::size_t i = 0; i < leaves * perLeaf; ++i) {
+    owned.push_back(std::make_unique<Point>(Point::random()));
+    noise.push_back(std::make_unique<char[]>(1000 + i % 3000));
+  }
+  std::vector<Point *> order;
+  for (auto &p : owned)
+    order.push_back(p.get());
+  std::shuffle(order.begin(), order.end(), std::mt19937(7));
+
+  std::vector<LeafBlock> rows, tiles;
+  for (std::size_t l = 0; l < leaves; ++l) {
+    rows.emplace_back(0);
+    tiles.emplace_back(64);
+    for (std::size_t i = 0; i < perLeaf; ++i) {
+      rows.back().push(*order[l * perLeaf + i]);
+      tiles.back().push(*order[l * perLeaf + i]);
+    }
+  }
+
+  Point q = Point::random();
+  std::vector<float> out(perLeaf);
+  float sink = 0.0f;
+  auto time = [&](auto &&scan) {
+    auto start = Clock::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+      for (std::size_t l = 0; l < leaves; ++l) {
+        scan(l);
+        sink += out[0];
+      }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start)
+               .count() /
+           double(rounds * leaves * perLeaf);
+  };
+  double chase = time([&](std::size_t l) {
+    for (std::size_t i = 0; i < perLeaf; ++i)
+      out[i] = Point::squaredDistance(q, *order[l * perLeaf + i]);
+  });
+  double contiguous = time([&](std::size_t l) {
+    rows[l].squaredDistances(q.data(), out.data());
+  });
+  // Cota tipica de k-NN: la mediana de las distancias al cuadrado
+  std::vector<float> all;
+  for (Point *p : order)
+    all.push_back(Point::squaredDistance(q, *p));
+  std::nth_element(all.begin(), all.begin() + all.size() / 2, all.end());
+  const float bound = all[all.size() / 2];
+  double blocked = time([&](std::size_t l) {
+    tiles[l].squaredDistances(q.data(), out.data(), bound);
+  });
+  if (sink == 1.0f)
+    std::cout << "";
+
+  std::cout << "=== Recorrido de hojas, " << leaves << " x " << perLeaf
+            << " puntos (ns/punto) ===\n";
+  std::cout << std::setw(22) << "Point* sueltos" << std::setw(10) << chase
+            << '\n';
+  std::cout << std::setw(22) << "bloque en filas" << std::setw(10)
+            << contiguous << '\n';
+  std::cout << std::setw(22) << "bloques de 64 + cota" << std::setw(10)
+            << blocked << "\n\n";
+}
+
+// -------------------------------------------------------------
+// Consultas sobre un arbol construido con insert
+// -------------------------------------------------------------
+void benchQueries(std::size_t dimBlock) {
+  const std::size_t N = 5000, Q = 200;
+  std::vector<Point> points;
+  for (std::size_t i = 0; i < N; ++i)
+    points.push_back(Point::random());
+  std::vector<Point> queries;
+  for (std::size_t i = 0; i < Q; ++i)
+    queries.push_back(Point::random());
+
+  SRTree tree(18, dimBlock);
+  auto start = Clock::now();
+  for (const Point &p : points)
+    tree.insert(p);
+  double buildMs =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  start = Clock::now();
+  std::size_t found = 0;
+  SRQueryStats stats;
+  for (const Point &q : queries)
+    found += tree.kNearestNeighbors(q, 10, &stats).size();
+  double knnUs =
+      std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+  std::cout << "=== SR-tree, N=" << N << ", dimBlock=" << dimBlock
+            << " ===\n";
+  std::cout << std::setw(22) << "insert ms" << std::setw(10) << buildMs
+            << '\n';
+  std::cout << std::setw(22) << "knn k=10 us/consulta" << std::setw(10)
+            << knnUs / Q << "   (" << found << " vecinos)\n";
+  std::cout << std::setw(22) << "knn nodos/consulta" << std::setw(10)
+            << double(stats.nodesVisited) / Q << "\n\n";
+}
+
+// -------------------------------------------------------------
+// Hojas cuantizadas: recall@10 vs memoria
+// -------------------------------------------------------------
+// Bytes de coordenadas en las hojas
+std::size_t leafBytes(const SRNode *node) {
+  std::size_t total = node->getBlock().bytes();
+  for (const SRNode *child : node->getChildren())
+    total += leafBytes(child);
+  return total;
+}
+
+void benchQuantized() {
+  const std::size_t N = 5000, Q = 100, K = 10, clusters = 50;
+  const std::string path = "bench_vectors.bin";
+  // Datos agrupados, como embeddings: centros uniformes mas ruido
+  std::mt19937 gen(4242);
+  std::normal_distribution<float> noise(0.0f, 0.05f);
+  std::vector<Point> centers, points, queries;
+  for (std::size_t c = 0; c < clusters; ++c)
+    centers.push_back(Point::random());
+  auto near = [&](const Point &c) {
+    Point p = c;
+    for (std::size_t d = 0; d < DIM; ++d)
+      p[d] += noise(gen);
+    return p;
+  };
+  for (std::size_t i = 0; i < N; ++i)
+    points.push_back(near(centers[i % clusters]));
+  for (std::size_t i = 0; i < Q; ++i)
+    queries.push_back(near(centers[(i * 7) % clusters]));
+
+  std::vector<std::vector<float>> truth;
+  for (const Point &q : queries) {
+    std::vector<float> d;
+    for (const Point &p : points)
+      d.push_back(Point::squaredDistance(q, p));
+    std::nth_element(d.begin(), d.begin() + K - 1, d.end());
+    truth.push_back({d[K - 1]});
+  }
+
+  std::cout << "=== Hojas cuantizadas, N=" << N << ", k=" << K << " ===\n";
+  std::cout << std::setw(10) << "codec" << std::setw(8) << "rerank"
+            << std::setw(10) << "recall" << std::setw(14) << "hoja B/punto"
+            << std::setw(14) << "RAM B/punto" << std::setw(12) << "us/cons"
+            << '\n';
+  struct Config {
+    const char *name;
+    Codec codec;
+    std::size_t rerank;
+  };
+  for (Config cfg : {Config{"float32", Codec::Float32, 1},
+                     Config{"float16", Codec::Float16, 1},
+                     Config{"float16", Codec::Float16, 2},
+                     Config{"int8", Codec::Int8, 1},
+                     Config{"int8", Codec::Int8, 2},
+                     Config{"int8", Codec::Int8, 4},
+                     Config{"int8", Codec::Int8, 8}}) {
+    SRTree tree(18);
+    for (const Point &p : points)
+      tree.insert(p);
+    // float32 se queda con los puntos en los bloques de las hojas
+    if (cfg.codec != Codec::Float32)
+      tree.quantize(cfg.codec, path);
+    tree.setRerank(cfg.rerank);
+
+    std::size_t hits = 0;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < Q; ++i)
+      for (Point *p : tree.kNearestNeighbors(queries[i], K))
+        if (Point::squaredDistance(queries[i], *p) <= truth[i][0])
+          hits++;
+    double us =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count() /
+        Q;
+    // Con codigos y sin archivo los puntos completos quedan en memoria;
+    // sin codigos el bloque de cada hoja es su unica copia
+    std::size_t leaf = leafBytes(tree.getRoot());
+    std::size_t ram =
+        leaf + (cfg.codec == Codec::Float32 || tree.getVectorFile().size()
+                    ? 0
+                    : N * sizeof(Point));
+    std::cout << std::setw(10) << cfg.name << std::setw(8) << cfg.rerank
+              << std::setw(10) << std::setprecision(3)
+              << double(hits) / double(Q * K) << std::setw(14)
+              << std::setprecision(0) << double(leaf) / N << std::setw(14)
+              << double(ram) / N << std::setw(12) << std::setprecision(1)
+              << us << '\n';
+  }
+  std::remove(path.c_str());
+  std::cout << "(con codigos los vectores completos, " << sizeof(Point)
+            << " B/punto, quedan en disco y se leen por mmap)\n\n";
+}
+
+// -------------------------------------------------------------
+// Construccion: insert uno a uno vs bulkLoad
+// -------------------------------------------------------------
+void benchBulkLoad(std::size_t N) {
+  const std::size_t Q = 100;
+  std::vector<Point> points, queries;
+  for (std::size_t i = 0; i < N; ++i)
+    points.push_back(Point::random());
+  for (std::size_t i = 0; i < Q; ++i)
+    queries.push_back(Point::random());
+  const std::size_t hw =
+      std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+  std::cout << "=== Construccion, N=" << N << " ===\n";
+  std::cout << std::setw(22) << "metodo" << std::setw(12) << "ms"
+            << std::setw(14) << "knn us/cons" << '\n';
+  auto report = [&](const char *name, auto &&build) {
+    SRTree tree(18);
+    auto start = Clock::now();
+    build(tree);
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    start = Clock::now();
+    for (const Point &q : queries)
+      tree.kNearestNeighbors(q, 10);
+    double us =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count() /
+        Q;
+    std::cout << std::setw(22) << name << std::setw(12)
+              << std::setprecision(1) << ms << std::setw(14) << us << '\n';
+  };
+  report("insert", [&](SRTree &t) {
+    for (const Point &p : points)
+      t.insert(p);
+  });
+  report("bulkLoad 1 thread", [&](SRTree &t) { t.bulkLoad(points, 1); });
+  std::string name = "bulkLoad " + std::to_string(hw) + " threads";
+  report(name.c_str(), [&](SRTree &t) { t.bulkLoad(points, hw); });
+  std::cout << '\n';
+}
+
+// -------------------------------------------------------------
+// Cotas de poda: nodos visitados por consulta
+// -------------------------------------------------------------
+void benchBounds(bool clustered) {
+  const std::size_t N = 20000, Q = 100;
+  std::mt19937 gen(777);
+  std::normal_distribution<float> noise(0.0f, 0.05f);
+  std::vector<Point> centers;
+  for (int c = 0; c < 100; ++c)
+    centers.push_back(Point::random());
+  auto sample = [&]() {
+    if (!clustered)
+      return Point::random();
+    Point p = centers[gen() % centers.size()];
+    for (std::size_t d = 0; d < DIM; ++d)
+      p[d] += noise(gen);
+    return p;
+  };
+  std::vector<Point> points, queries;
+  for (std::size_t i = 0; i < N; ++i)
+    points.push_back(sample());
+  for (std::size_t i = 0; i < Q; ++i)
+    queries.push_back(sample());
+  SRTree tree(18);
+  for (const Point &p : points)
+    tree.insert(p);
+
+  std::cout << "=== Nodos visitados, N=" << N << ", datos "
+            << (clustered ? "agrupados" : "uniformes") << " ===\n";
+  std::cout << std::setw(22) << "consulta" << std::setw(12) << "nodos"
+            << std::setw(12) << "us/cons" << '\n';
+  auto report = [&](const char *name, auto &&query) {
+    SRQueryStats stats;
+    auto start = Clock::now();
+    for (const Point &q : queries)
+      query(q, stats);
+    double us =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count() /
+        Q;
+    std::cout << std::setw(22) << name << std::setw(12)
+              << std::setprecision(1) << double(stats.nodesVisited) / Q
+              << std::setw(12) << us << '\n';
+  };
+  report("knn k=1", [&](const Point &q, SRQueryStats &st) {
+    tree.kNearestNeighbors(q, 1, &st);
+  });
+  report("knn k=10", [&](const Point &q, SRQueryStats &st) {
+    tree.kNearestNeighbors(q, 10, &st);
+  });
+  // Radio: distancia al decimo vecino, asi el rango devuelve ~10 puntos
+  report("esfera r=d10", [&](const Point &q, SRQueryStats &st) {
+    std::vector<Point *> nn = tree.kNearestNeighbors(q, 10);
+    tree.rangeQuery(Sphere(q, Point::distance(q, *nn.back())), &st);
+  });
+  std::cout << '\n';
+}
+
+// -------------------------------------------------------------
+// Recorrido: memoria de la cola BFS vs pila DFS, vector vs callback
+// -------------------------------------------------------------
+// Pico de la cola de un BFS que, como el recorrido de rangeQueryEach,
+// encola todos los hijos y poda al sacar el nodo
+std::size_t peakQueue(const SRTree &tree, const Sphere &sphere) {
+  std::deque<const SRNode *> cola{tree.getRoot()};
+  std::size_t peak = 1;
+  while (!cola.empty()) {
+    const SRNode *n = cola.front();
+    cola.pop_front();
+    float d = Point::distance(sphere.center, n->getBoundingSphere().center);
+    if (d > sphere.radius + n->getBoundingSphere().radius ||
+        MBB::minDist(sphere.center, n->getBoundingBox()) > sphere.radius)
+      continue;
+    if (!n->getIsLeaf())
+      for (const SRNode *hijo : n->getChildren())
+        cola.push_back(hijo);
+    peak = std::max(peak, cola.size());
+  }
+  return peak;
+}
+
+void benchTraversal(std::size_t maxEntries) {
+  const std::size_t N = 20000, Q = 100;
+  std::vector<Point> points, queries;
+  for (std::size_t i = 0; i < N; ++i)
+    points.push_back(Point::random());
+  for (std::size_t i = 0; i < Q; ++i)
+    queries.push_back(Point::random());
+  SRTree tree(maxEntries);
+  for (const Point &p : points)
+    tree.insert(p);
+
+  // Radio grande: visita casi todo el arbol, el peor caso para la cola
+  std::vector<Sphere> spheres;
+  std::size_t peak = 0;
+  for (const Point &q : queries) {
+    std::vector<Point *> nn = tree.kNearestNeighbors(q, 200);
+    spheres.emplace_back(q, Point::distance(q, *nn.back()));
+    peak = std::max(peak, peakQueue(tree, spheres.back()));
+  }
+  const std::size_t pila =
+      1 + tree.height() * std::max<std::size_t>(2, maxEntries);
+
+  std::cout << "=== Recorrido, N=" << N << ", M=" << maxEntries
+            << ", altura=" << tree.height() << " ===\n";
+  std::cout << "  pico cola BFS: " << peak << " nodos ("
+            << peak * sizeof(SRNode *) << " B), pila DFS: " << pila
+            << " nodos (" << pila * sizeof(SRNode *) << " B)\n";
+  std::cout << std::setw(22) << "consulta" << std::setw(12) << "us/cons"
+            << '\n';
+  auto report = [&](const char *name, auto &&query) {
+    std::size_t sink = 0;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < Q; ++i)
+      sink += query(i);
+    double us =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count() /
+        Q;
+    if (sink == 1)
+      std::cout << "";
+    std::cout << std::setw(22) << name << std::setw(12)
+              << std::setprecision(1) << us << '\n';
+  };
+  report("esfera vector", [&](std::size_t i) {
+    return tree.rangeQuery(spheres[i]).size();
+  });
+  report("esfera callback", [&](std::size_t i) {
+    std::size_t n = 0;
+    tree.rangeQueryEach(spheres[i], [&n](Point *) { n++; });
+    return n;
+  });
+  report("esfera primer punto", [&](std::size_t i) {
+    std::size_t n = 0;
+    tree.rangeQueryEach(spheres[i], [&n](Point *) { return ++n < 1; });
+    return n;
+  });
+  report("search", [&](std::size_t i) {
+    return std::size_t(tree.search(points[i * (N / Q)]));
+  });
+  std::cout << '\n';
+}
+
+int main() {
+  benchKernels(50);
+  benchKernels(5000);
+  benchLeafScan();
+  benchQueries(0);
+  benchQueries(64);
+  benchQuantized();
+  benchBulkLoad(20000);
+  benchBounds(false);
+  benchBounds(true);
+  benchTraversal(18);
+  benchTraversal(64);
+  return 0;
+}
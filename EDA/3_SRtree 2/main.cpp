@@ -1,8 +1,11 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <string>
 #include <vector>
@@ -327,6 +330,530 @@ bool testKNearestNeighbors(const SRTree &tree,
   return allOK;
 }
 
+// -------------------------------------------------------------
+// TEST 6: Nucleos de distancia L2
+// -------------------------------------------------------------
+bool testL2Kernels() {
+  std::vector<std::pair<const char *, l2::Kernel>> kernels = {
+      {"scalar", l2::squaredScalar}};
+#ifdef L2_KERNEL_X86
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    kernels.push_back({"avx2", l2::squaredAvx2});
+  if (__builtin_cpu_supports("avx512f"))
+    kernels.push_back({"avx512", l2::squaredAvx512});
+#endif
+
+  std::mt19937 gen(777);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> a(DIM + 1), b(DIM + 1);
+  for (std::size_t i = 0; i <= DIM; ++i) {
+    a[i] = dist(gen);
+    b[i] = dist(gen);
+  }
+
+  // Largos que no son multiplo del ancho y punteros desalineados
+  bool allOK = true;
+  for (std::size_t n : {0, 1, 7, 8, 15, 17, 31, 33, 63, 65, 100, 767}) {
+    for (std::size_t offset : {0, 1}) {
+      double ref = 0.0;
+      for (std::size_t i = 0; i < n; ++i) {
+        double diff = double(a[offset + i]) - double(b[offset + i]);
+        ref += diff * diff;
+      }
+      for (const auto &kernel : kernels) {
+        float got = kernel.second(a.data() + offset, b.data() + offset, n);
+        if (std::fabs(got - ref) > 1e-4 * (1.0 + ref)) {
+          std::cout << "[ERROR] Nucleo " << kernel.first << " con n=" << n
+                    << ": " << got << " vs " << ref << "\n";
+          allOK = false;
+        }
+      }
+    }
+  }
+
+  Point p = Point::random(0.0f, 1.0f), q = Point::random(0.0f, 1.0f);
+  float d = Point::distance(p, q);
+  if (std::fabs(d * d - Point::squaredDistance(p, q)) > 1e-3f)
+    allOK = false;
+
+  if (allOK) {
+    std::cout << "[OK] Test 6 (Nucleos L2, " << l2::kernelName()
+              << ") pasó correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 6 (Nucleos L2) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 7: Hojas contiguas (con y sin bloques de dimensiones)
+// -------------------------------------------------------------
+bool testLeafBlocks(const std::vector<Point> &allPoints,
+                    std::size_t maxEntries) {
+  bool allOK = true;
+  std::mt19937 gen(2468);
+  std::uniform_int_distribution<std::size_t> distIdx(0, allPoints.size() - 1);
+
+  for (std::size_t dimBlock : {std::size_t(0), std::size_t(64)}) {
+    SRTree tree(maxEntries, dimBlock);
+    for (const Point &p : allPoints)
+      tree.insert(p);
+
+    // Cada hoja guarda sus puntos, alineados, y los Point* de la hoja son
+    // sus filas: no hay otra copia
+    std::size_t stored = 0;
+    std::function<void(const SRNode *)> recurse = [&](const SRNode *node) {
+      if (!node->getIsLeaf()) {
+        for (SRNode *child : node->getChildren())
+          recurse(child);
+        return;
+      }
+      const LeafBlock &block = node->getBlock();
+      if (block.size() != node->getPoints().size() ||
+          block.capacity() > maxEntries + 1 ||
+          reinterpret_cast<std::uintptr_t>(block.data()) % LeafBlock::kAlign)
+        allOK = false;
+      for (std::size_t i = 0; i < block.size() && allOK; ++i)
+        if (node->getPoints()[i] != block.point(i))
+          allOK = false;
+      stored += block.size();
+    };
+    recurse(tree.getRoot());
+    if (stored != allPoints.size())
+      allOK = false;
+
+    // Todos los puntos insertados siguen en las hojas tras las divisiones
+    for (std::size_t i = 0; i < allPoints.size() && allOK; i += 7)
+      if (!tree.search(allPoints[i]))
+        allOK = false;
+
+    for (int t = 0; t < 5 && allOK; ++t) {
+      Point query = Point::random(0.0f, 1.0f);
+      std::vector<float> brute;
+      for (const Point &p : allPoints)
+        brute.push_back(Point::distance(query, p));
+      std::sort(brute.begin(), brute.end());
+      std::vector<float> treeDists;
+      for (Point *p : tree.kNearestNeighbors(query, 8))
+        treeDists.push_back(Point::distance(query, *p));
+      std::sort(treeDists.begin(), treeDists.end());
+      brute.resize(8);
+      if (!sameDistanceList(treeDists, brute))
+        allOK = false;
+
+      Sphere sph(allPoints[distIdx(gen)], brute[7]);
+      std::size_t inside = 0;
+      for (const Point &p : allPoints)
+        if (Point::distance(p, sph.center) <= sph.radius)
+          inside++;
+      if (tree.rangeQuery(sph).size() != inside)
+        allOK = false;
+    }
+  }
+
+  if (allOK) {
+    std::cout << "[OK] Test 7 (Hojas contiguas) pasó correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 7 (Hojas contiguas) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 8: Hojas cuantizadas (Float16 / Int8) con re-ranking
+// -------------------------------------------------------------
+bool testQuantized(const std::vector<Point> &allPoints,
+                   std::size_t maxEntries) {
+  bool allOK = true;
+  const std::string path = "srtree_vectors.bin";
+  std::mt19937 gen(97531);
+  std::uniform_int_distribution<std::size_t> distIdx(0, allPoints.size() - 1);
+
+  for (float v : {0.0f, 1.0f, -2.5f, 0.333f, 65504.0f, 1e-6f})
+    if (std::fabs(Quantizer::fromHalf(Quantizer::toHalf(v)) - v) >
+        std::fabs(v) / 1024.0f + 1e-7f)
+      allOK = false;
+
+  for (Codec codec : {Codec::Float16, Codec::Int8}) {
+    SRTree tree(maxEntries);
+    for (const Point &p : allPoints)
+      tree.insert(p);
+    tree.quantize(codec, path);
+    if (tree.getVectorFile().size() != allPoints.size())
+      allOK = false;
+
+    // error(i) es la distancia real entre el punto y su reconstruccion
+    std::function<void(const SRNode *)> recurse = [&](const SRNode *node) {
+      for (SRNode *child : node->getChildren())
+        recurse(child);
+      const LeafBlock &block = node->getBlock();
+      if (!node->getIsLeaf() || !allOK)
+        return;
+      if (!block.quantized() || block.size() != node->getPoints().size())
+        allOK = false;
+      for (std::size_t i = 0; i < block.size() && allOK; ++i) {
+        float d2 = 0.0f;
+        for (std::size_t d = 0; d < DIM; ++d) {
+          float diff = block.at(i, d) - (*node->getPoints()[i])[d];
+          d2 += diff * diff;
+        }
+        if (std::fabs(std::sqrt(d2) - block.error(i)) > 1e-4f)
+          allOK = false;
+      }
+    };
+    recurse(tree.getRoot());
+
+    for (int t = 0; t < 50 && allOK; ++t)
+      if (!tree.search(allPoints[distIdx(gen)]))
+        allOK = false;
+
+    // Rango exacto gracias a la cota de error; kNN con recall alto
+    std::size_t hits = 0, total = 0;
+    for (int t = 0; t < 5 && allOK; ++t) {
+      Point query = Point::random(0.0f, 1.0f);
+      std::vector<float> brute;
+      for (const Point &p : allPoints)
+        brute.push_back(Point::distance(query, p));
+      std::sort(brute.begin(), brute.end());
+      std::vector<Point *> nbrs = tree.kNearestNeighbors(query, 8);
+      if (nbrs.size() != 8)
+        allOK = false;
+      for (std::size_t i = 0; i < nbrs.size(); ++i) {
+        float d = Point::distance(query, *nbrs[i]);
+        if (i && d < Point::distance(query, *nbrs[i - 1]))
+          allOK = false;
+        if (d <= brute[7] + FLOAT_TOL)
+          hits++;
+      }
+      total += 8;
+
+      Sphere sph(allPoints[distIdx(gen)], brute[7]);
+      std::size_t inside = 0;
+      for (const Point &p : allPoints)
+        if (Point::distance(p, sph.center) <= sph.radius)
+          inside++;
+      if (tree.rangeQuery(sph).size() != inside)
+        allOK = false;
+    }
+    if (hits * 10 < total * 9)
+      allOK = false;
+
+    // Lo insertado despues de quantize tambien se codifica
+    Point extra = Point::random(0.0f, 1.0f);
+    tree.insert(extra);
+    std::vector<Point *> nn = tree.kNearestNeighbors(extra, 1);
+    if (!tree.search(extra) || nn.empty() || !equalPoint(*nn[0], extra))
+      allOK = false;
+  }
+  std::remove(path.c_str());
+
+  if (allOK) {
+    std::cout << "[OK] Test 8 (Hojas cuantizadas) pasó correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 8 (Hojas cuantizadas) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 9: Carga masiva (STR sobre ejes principales)
+// -------------------------------------------------------------
+bool testBulkLoad(const std::vector<Point> &allPoints,
+                  std::size_t maxEntries) {
+  bool allOK = true;
+  std::mt19937 gen(8642);
+  std::uniform_int_distribution<std::size_t> distIdx(0, allPoints.size() - 1);
+
+  // Con 1 y 4 threads, sobre un arbol que ya tenia la primera mitad y
+  // sobre uno ya cargado en masa
+  for (int mode = 0; mode < 4 && allOK; ++mode) {
+    SRTree tree(maxEntries);
+    std::size_t half = allPoints.size() / 2;
+    if (mode == 2) {
+      for (std::size_t i = 0; i < half; ++i)
+        tree.insert(allPoints[i]);
+      tree.bulkLoad(std::vector<Point>(allPoints.begin() + half,
+                                       allPoints.end()));
+    } else if (mode == 3) {
+      tree.bulkLoad(std::vector<Point>(allPoints.begin(),
+                                       allPoints.begin() + half));
+      tree.bulkLoad(std::vector<Point>(allPoints.begin() + half,
+                                       allPoints.end()));
+    } else {
+      tree.bulkLoad(allPoints, mode == 0 ? 1 : 4);
+    }
+
+    // Hojas a la misma profundidad, sin desbordes y con volumenes validos
+    std::size_t count = 0;
+    int leafDepth = -1;
+    std::function<void(const SRNode *, int)> recurse =
+        [&](const SRNode *node, int depth) {
+          std::size_t fanout = node->getIsLeaf() ? node->getPoints().size()
+                                                 : node->getChildren().size();
+          if (fanout == 0 || fanout > maxEntries)
+            allOK = false;
+          std::vector<Point *> under;
+          collectPointsFromSubtree(node, under);
+          for (Point *p : under)
+            if (!pointInBox(*p, node->getBoundingBox()) ||
+                !pointInSphere(*p, node->getBoundingSphere()))
+              allOK = false;
+          if (node->getIsLeaf()) {
+            if (leafDepth < 0)
+              leafDepth = depth;
+            if (depth != leafDepth ||
+                node->getBlock().size() != node->getPoints().size())
+              allOK = false;
+            count += node->getPoints().size();
+            return;
+          }
+          for (SRNode *child : node->getChildren()) {
+            if (child->getParent() != node)
+              allOK = false;
+            recurse(child, depth + 1);
+          }
+        };
+    recurse(tree.getRoot(), 0);
+    if (count != allPoints.size() || tree.getRoot()->getParent() ||
+        tree.height() != std::size_t(leafDepth))
+      allOK = false;
+
+    for (const Point &p : allPoints)
+      if (!tree.search(p)) {
+        allOK = false;
+        break;
+      }
+
+    for (int t = 0; t < 5 && allOK; ++t) {
+      Point query = Point::random(0.0f, 1.0f);
+      std::vector<float> brute;
+      for (const Point &p : allPoints)
+        brute.push_back(Point::distance(query, p));
+      std::sort(brute.begin(), brute.end());
+      std::vector<float> treeDists;
+      for (Point *p : tree.kNearestNeighbors(query, 8))
+        treeDists.push_back(Point::distance(query, *p));
+      std::sort(treeDists.begin(), treeDists.end());
+      brute.resize(8);
+      if (!sameDistanceList(treeDists, brute))
+        allOK = false;
+
+      Sphere sph(allPoints[distIdx(gen)], brute[7]);
+      std::size_t inside = 0;
+      for (const Point &p : allPoints)
+        if (Point::distance(p, sph.center) <= sph.radius)
+          inside++;
+      if (tree.rangeQuery(sph).size() != inside)
+        allOK = false;
+    }
+
+    // insert sigue funcionando sobre el arbol cargado
+    Point extra = Point::random(0.0f, 1.0f);
+    tree.insert(extra);
+    if (!tree.search(extra))
+      allOK = false;
+
+    // Mover pasa los nodos al destino y deja vacio al origen
+    SRTree moved(std::move(tree));
+    if (tree.getRoot() || !moved.search(extra))
+      allOK = false;
+    tree = std::move(moved);
+    if (moved.getRoot() || !tree.search(extra))
+      allOK = false;
+  }
+
+  if (allOK) {
+    std::cout << "[OK] Test 9 (Carga masiva) pasó correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 9 (Carga masiva) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 10: Division por varianza
+// -------------------------------------------------------------
+bool testVarianceSplit(const SRTree &tree, std::size_t maxEntries) {
+  bool allOK = true;
+  // Cada division deja al menos el 40% de maxEntries + 1 en cada lado
+  const std::size_t minimo = (maxEntries + 1) * 2 / 5;
+  std::function<void(const SRNode *)> recurse = [&](const SRNode *node) {
+    std::size_t fanout = node->getIsLeaf() ? node->getPoints().size()
+                                           : node->getChildren().size();
+    if (fanout > maxEntries ||
+        (node != tree.getRoot() && fanout < minimo))
+      allOK = false;
+    for (SRNode *child : node->getChildren())
+      recurse(child);
+  };
+  recurse(tree.getRoot());
+
+  // El corte elegido es el de menor solape entre las esferas de los grupos
+  std::vector<Sphere> entries;
+  for (int i = 0; i < 10; ++i)
+    entries.push_back(Sphere(Point::random(0.0f, 1.0f), 0.0f));
+  for (int i = 0; i < 10; ++i)
+    entries.push_back(Sphere(Point::random(5.0f, 6.0f), 0.0f));
+  std::size_t cut = 0;
+  std::vector<std::size_t> order = SRNode::dividirPorVarianza(entries, cut);
+  if (cut != 10)
+    allOK = false;
+  for (std::size_t i = 0; i < order.size(); ++i)
+    if ((order[i] < 10) != (i < cut))
+      allOK = false;
+
+  SRQueryStats stats;
+  tree.kNearestNeighbors(Point::random(0.0f, 1.0f), 5, &stats);
+  if (stats.nodesVisited == 0 || stats.distanceComputations == 0)
+    allOK = false;
+
+  if (allOK) {
+    std::cout << "[OK] Test 10 (Division por varianza) pasó correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 10 (Division por varianza) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 11: Cotas MINDIST / MINMAXDIST
+// -------------------------------------------------------------
+bool testBoxBounds(const SRTree &tree, const std::vector<Point> &allPoints) {
+  bool allOK = true;
+  std::mt19937 gen(1357);
+  std::uniform_int_distribution<std::size_t> distIdx(0, allPoints.size() - 1);
+
+  for (int t = 0; t < 20 && allOK; ++t) {
+    // Caja de un grupo de puntos: cada cara toca alguno
+    std::vector<const Point *> group;
+    for (int i = 0; i < 12; ++i)
+      group.push_back(&allPoints[distIdx(gen)]);
+    MBB box(*group[0]);
+    for (const Point *p : group)
+      box.expandToInclude(*p);
+
+    Point query = t % 2 ? Point::random(-0.5f, 1.5f) : *group[0];
+    float nearest = std::numeric_limits<float>::max();
+    for (const Point *p : group)
+      nearest = std::min(nearest, Point::distance(query, *p));
+    float lower = MBB::minDist(query, box);
+    float upper = MBB::minMaxDist(query, box);
+    if (lower > nearest + 1e-4f || upper < nearest - 1e-4f ||
+        upper > MBB::maxDist(query, box) + 1e-4f)
+      allOK = false;
+
+    // Todos los nucleos de caja dan lo mismo que el escalar
+    const float *q = query.data(), *lo = box.minCorner.data(),
+                *hi = box.maxCorner.data();
+    for (std::size_t n : {std::size_t(DIM), std::size_t(37)}) {
+      float ref = l2::boxScalar(q, lo, hi, n);
+      float tol = 1e-5f * std::max(1.0f, ref);
+      if (std::fabs(l2::boxSquared(q, lo, hi, n) - ref) > tol)
+        allOK = false;
+#ifdef L2_KERNEL_X86
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+          std::fabs(l2::boxAvx2(q, lo, hi, n) - ref) > tol)
+        allOK = false;
+      if (__builtin_cpu_supports("avx512f") &&
+          std::fabs(l2::boxAvx512(q, lo, hi, n) - ref) > tol)
+        allOK = false;
+#endif
+    }
+  }
+
+  // k = 1 usa ademas MINMAXDIST para podar
+  for (int t = 0; t < 10 && allOK; ++t) {
+    Point query = Point::random(0.0f, 1.0f);
+    float nearest = std::numeric_limits<float>::max();
+    for (const Point &p : allPoints)
+      nearest = std::min(nearest, Point::distance(query, p));
+    std::vector<Point *> nn = tree.kNearestNeighbors(query, 1);
+    if (nn.size() != 1 ||
+        std::fabs(Point::distance(query, *nn[0]) - nearest) > FLOAT_TOL)
+      allOK = false;
+  }
+
+  if (allOK) {
+    std::cout << "[OK] Test 11 (Cotas MINDIST/MINMAXDIST) pasó "
+                 "correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 11 (Cotas MINDIST/MINMAXDIST) falló.\n";
+  }
+  return allOK;
+}
+
+// -------------------------------------------------------------
+// TEST 12: Recorrido en profundidad con callback
+// -------------------------------------------------------------
+bool testDepthFirst(const SRTree &tree, const std::vector<Point> &allPoints) {
+  bool allOK = true;
+  std::mt19937 gen(24680);
+  std::uniform_int_distribution<std::size_t> distIdx(0, allPoints.size() - 1);
+
+  // Nodos grandes: la pila y las distancias de hoja pasan a memoria
+  // dinamica
+  SRTree wide(300);
+  // Bloques de 64 dimensiones: las distancias de hoja suman en otro orden
+  // que Point::distance y el borde de la esfera debe coincidir igual
+  SRTree strips(18, 64);
+  for (const Point &p : allPoints) {
+    wide.insert(p);
+    strips.insert(p);
+  }
+
+  for (const SRTree *t : std::vector<const SRTree *>{&tree, &wide, &strips}) {
+    std::size_t depth = 0;
+    for (const SRNode *n = t->getRoot(); !n->getIsLeaf();
+         n = n->getChildren().back())
+      depth++;
+    if (t->height() != depth)
+      allOK = false;
+
+    for (int q = 0; q < 20 && allOK; ++q) {
+      const Point &center = allPoints[distIdx(gen)];
+      std::vector<float> dists;
+      for (const Point &p : allPoints)
+        dists.push_back(Point::distance(center, p));
+      std::sort(dists.begin(), dists.end());
+      Sphere sph(center, dists[20]);
+      MBB box(center);
+      for (std::size_t d = 0; d < DIM; ++d) {
+        box.minCorner[d] -= 0.45f;
+        box.maxCorner[d] += 0.45f;
+      }
+
+      std::vector<Point *> streamed;
+      t->rangeQueryEach(sph, [&](Point *p) { streamed.push_back(p); });
+      std::vector<Point *> collected = t->rangeQuery(sph);
+      if (streamed != collected || streamed.size() < 21)
+        allOK = false;
+
+      streamed.clear();
+      t->rangeQueryEach(box, [&](Point *p) { streamed.push_back(p); });
+      if (streamed != t->rangeQuery(box))
+        allOK = false;
+
+      // Devolver false corta el recorrido
+      std::size_t seen = 0;
+      t->rangeQueryEach(sph, [&](Point *) { return ++seen < 3; });
+      if (seen != 3)
+        allOK = false;
+    }
+
+    for (int q = 0; q < 50 && allOK; ++q)
+      if (!t->search(allPoints[distIdx(gen)]))
+        allOK = false;
+  }
+
+  if (allOK) {
+    std::cout << "[OK] Test 12 (Recorrido en profundidad) pasó "
+                 "correctamente.\n";
+  } else {
+    std::cout << "[ERROR] Test 12 (Recorrido en profundidad) falló.\n";
+  }
+  return allOK;
+}
+
 int main() {
   bool overallOK = true;
 
@@ -367,6 +894,34 @@ int main() {
   if (!testKNearestNeighbors(tree, allPoints))
     overallOK = false;
 
+  std::cout << "\n=== TEST 6: Nucleos L2 ===\n";
+  if (!testL2Kernels())
+    overallOK = false;
+
+  std::cout << "\n=== TEST 7: Hojas contiguas ===\n";
+  if (!testLeafBlocks(allPoints, MAX_ENTRIES))
+    overallOK = false;
+
+  std::cout << "\n=== TEST 8: Hojas cuantizadas ===\n";
+  if (!testQuantized(allPoints, MAX_ENTRIES))
+    overallOK = false;
+
+  std::cout << "\n=== TEST 9: Carga masiva ===\n";
+  if (!testBulkLoad(allPoints, MAX_ENTRIES))
+    overallOK = false;
+
+  std::cout << "\n=== TEST 10: Division por varianza ===\n";
+  if (!testVarianceSplit(tree, MAX_ENTRIES))
+    overallOK = false;
+
+  std::cout << "\n=== TEST 11: Cotas MINDIST/MINMAXDIST ===\n";
+  if (!testBoxBounds(tree, allPoints))
+    overallOK = false;
+
+  std::cout << "\n=== TEST 12: Recorrido en profundidad ===\n";
+  if (!testDepthFirst(tree, allPoints))
+    overallOK = false;
+
   if (overallOK) {
     std::cout << "\n>>> TODOS LOS TESTS PASARON!! <<<\nAun puedes aprobar :D\n";
     return 0;
@@ -0,0 +1,158 @@
+#ifndef CONCURRENT_MTREE_H
+#define CONCURRENT_MTREE_H
+
+#include "Mtree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Reclamacion por epocas. Cada lector anuncia en un slot la epoca global al
+// entrar y lo limpia al salir; lo retirado en la epoca E se libera cuando
+// ningun slot activo tiene una epoca <= E.
+class EpochDomain {
+public:
+  static constexpr std::size_t kSlots = 128;
+
+  class ReadGuard {
+  public:
+    explicit ReadGuard(const EpochDomain &domain)
+        : _slot(domain.enter()) {}
+    ~ReadGuard() { _slot->store(0, std::memory_order_release); }
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+
+  private:
+    std::atomic<std::uint64_t> *_slot;
+  };
+
+  // Cierra la epoca actual y la devuelve: lo retirado con ese numero ya no
+  // es visible para lectores que entren despues
+  std::uint64_t advance() { return _epoch.fetch_add(1); }
+
+  // Menor epoca anunciada por un lector activo (UINT64_MAX si no hay)
+  std::uint64_t oldestActive() const {
+    std::uint64_t oldest = UINT64_MAX;
+    for (const Slot &s : _slots) {
+      std::uint64_t e = s.epoch.load();
+      if (e != 0 && e < oldest)
+        oldest = e;
+    }
+    return oldest;
+  }
+
+private:
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> epoch{0}; // 0 = libre
+  };
+
+  std::atomic<std::uint64_t> _epoch{1};
+  mutable Slot _slots[kSlots];
+
+  // Toma un slot libre; el anuncio (seq_cst) va antes de leer la raiz
+  std::atomic<std::uint64_t> *enter() const {
+    thread_local std::size_t hint =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % kSlots;
+    for (std::size_t tries = 1;; ++tries) {
+      std::size_t i = (hint + tries - 1) % kSlots;
+      std::uint64_t expected = 0;
+      if (_slots[i].epoch.compare_exchange_strong(expected, _epoch.load())) {
+        hint = i;
+        return &_slots[i].epoch;
+      }
+      // Mas lectores simultaneos que slots: se espera a que salga alguno
+      if (tries % kSlots == 0)
+        std::this_thread::yield();
+    }
+  }
+};
+
+// M-tree para muchos lectores y pocos escritores. Las consultas no toman
+// locks: leen la raiz publicada y recorren nodos que ya no cambian. Cada
+// insert (serializado por un mutex) copia el camino raiz-hoja, modifica las
+// copias y publica la raiz nueva; los nodos reemplazados se liberan cuando
+// ningun lector que pudo verlos sigue activo.
+class ConcurrentMTree {
+public:
+  explicit ConcurrentMTree(std::size_t maxEntries = 10,
+                           SplitPolicy policy = SplitPolicy())
+      : _tree(maxEntries, policy) {}
+
+  ConcurrentMTree(const ConcurrentMTree &) = delete;
+  ConcurrentMTree &operator=(const ConcurrentMTree &) = delete;
+
+  void insert(const Object &obj) {
+    std::lock_guard<std::mutex> lock(_write);
+    MCopyOnWrite<MNode> cow;
+    _tree.insert(obj, &cow);
+    if (!cow.replaced.empty())
+      _retired.push_back({_epochs.advance(), std::move(cow.replaced)});
+    reclaim();
+  }
+
+  // Carga inicial; no debe correr junto con consultas
+  void bulkLoad(std::vector<Object> objects, std::size_t threads = 0) {
+    std::lock_guard<std::mutex> lock(_write);
+    _retired.clear();
+    _tree.bulkLoad(std::move(objects), threads);
+  }
+
+  bool search(const Object &obj, MQueryStats *stats = nullptr) const {
+    EpochDomain::ReadGuard guard(_epochs);
+    return _tree.search(obj, stats);
+  }
+
+  std::vector<Object *> rangeSearch(const Object &query,
+                                    std::size_t searchRadius,
+                                    MQueryStats *stats = nullptr) const {
+    EpochDomain::ReadGuard guard(_epochs);
+    return _tree.rangeSearch(query, searchRadius, stats);
+  }
+
+  std::vector<Object *> kNearestNeighbors(const Object &query, std::size_t k,
+                                          MQueryStats *stats = nullptr) const {
+    EpochDomain::ReadGuard guard(_epochs);
+    return _tree.kNearestNeighbors(query, k, stats);
+  }
+
+  // Solo con los escritores detenidos (pruebas, reportes)
+  const MTree &snapshot() const noexcept { return _tree; }
+
+  // Nodos reemplazados que esperan a que terminen lectores antiguos
+  std::size_t pendingNodes() const {
+    std::lock_guard<std::mutex> lock(_write);
+    std::size_t n = 0;
+    for (const Retired &r : _retired)
+      n += r.nodes.size();
+    return n;
+  }
+
+private:
+  struct Retired {
+    std::uint64_t epoch;
+    std::vector<MNode *> nodes;
+  };
+
+  MTree _tree;
+  EpochDomain _epochs;
+  mutable std::mutex _write;
+  std::vector<Retired> _retired; // en orden de epoca
+
+  void reclaim() {
+    const std::uint64_t oldest = _epochs.oldestActive();
+    std::size_t done = 0;
+    while (done < _retired.size() && _retired[done].epoch < oldest) {
+      for (MNode *node : _retired[done].nodes)
+        MNode::release(node);
+      done++;
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + done);
+  }
+};
+
+#endif // CONCURRENT_MTREE_H
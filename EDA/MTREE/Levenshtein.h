@@ -0,0 +1,231 @@
+#ifndef LEVENSHTEIN_H
+#define LEVENSHTEIN_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Nucleos de distancia de edicion usados por Object.
+// Todas las variantes acotadas devuelven la distancia exacta si es <= k y
+// k + 1 en otro caso.
+namespace levenshtein {
+
+// Filas que caben en la pila; claves mas largas usan un buffer por hilo que
+// solo crece, asi que una consulta no reserva memoria despues de la primera
+constexpr std::size_t kStackRow = 128;
+constexpr std::size_t kWord = 64;
+
+// DP completa (n+1)x(m+1): referencia para pruebas y benchmarks
+inline std::size_t reference(std::string_view a, std::string_view b) {
+    const std::size_t n = a.size();
+    const std::size_t m = b.size();
+
+    std::vector<std::vector<std::size_t>> dp(n + 1,
+        std::vector<std::size_t>(m + 1));
+
+    // Inicialización de bordes
+    for (std::size_t i = 0; i <= n; ++i) dp[i][0] = i;
+    for (std::size_t j = 0; j <= m; ++j) dp[0][j] = j;
+
+    for (std::size_t i = 1; i <= n; ++i) {
+        for (std::size_t j = 1; j <= m; ++j) {
+            std::size_t cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            dp[i][j] = std::min({
+                dp[i - 1][j] + 1,       // eliminación
+                dp[i][j - 1] + 1,       // inserción
+                dp[i - 1][j - 1] + cost // sustitución
+            });
+        }
+    }
+    return dp[n][m];
+}
+
+// Dos filas, banda de Ukkonen |i - j| <= k y salida temprana cuando toda la
+// banda supera k.
+inline std::size_t banded(std::string_view s1, std::string_view s2,
+                          std::size_t k) {
+    // b es la cadena corta: las filas tienen |b| + 1 celdas
+    const std::string_view a = s1.size() >= s2.size() ? s1 : s2;
+    const std::string_view b = s1.size() >= s2.size() ? s2 : s1;
+    const std::size_t n = a.size();
+    const std::size_t m = b.size();
+
+    if (k > n) k = n;
+    const std::size_t inf = k + 1;
+    if (n - m > k) return inf;
+    if (m == 0) return n;
+
+    std::size_t stackRows[2 * kStackRow];
+    std::size_t* prev = stackRows;
+    if (m + 1 > kStackRow) {
+        thread_local std::vector<std::size_t> heapRows;
+        if (heapRows.size() < 2 * (m + 1)) heapRows.resize(2 * (m + 1));
+        prev = heapRows.data();
+    }
+    std::size_t* cur = prev + (m + 1);
+
+    const std::size_t firstHi = std::min(m, k);
+    for (std::size_t j = 0; j <= firstHi; ++j) prev[j] = j;
+    if (firstHi < m) prev[firstHi + 1] = inf;
+
+    for (std::size_t i = 1; i <= n; ++i) {
+        const std::size_t lo = i > k ? i - k : 1;
+        const std::size_t hi = std::min(m, i + k);
+        if (lo > hi) return inf;
+
+        cur[lo - 1] = (lo == 1 && i <= k) ? i : inf;
+        std::size_t rowMin = cur[lo - 1];
+
+        for (std::size_t j = lo; j <= hi; ++j) {
+            const std::size_t cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            std::size_t v = std::min({
+                prev[j] + 1,           // eliminación
+                cur[j - 1] + 1,        // inserción
+                prev[j - 1] + cost     // sustitución
+            });
+            if (v > inf) v = inf;
+            cur[j] = v;
+            if (v < rowMin) rowMin = v;
+        }
+        if (hi < m) cur[hi + 1] = inf;
+
+        if (rowMin > k) return inf;
+        std::swap(prev, cur);
+    }
+    return std::min(prev[m], inf);
+}
+
+// Myers/Hyyrö con una palabra: el patron (|pattern| <= 64) ocupa los bits de
+// la columna y cada caracter del texto avanza la columna en O(1).
+inline std::size_t myers64(std::string_view text, std::string_view pattern,
+                           std::size_t k) {
+    const std::size_t n = text.size();
+    const std::size_t m = pattern.size();
+    if (k > std::max(n, m)) k = std::max(n, m);
+    if (m == 0) return std::min(n, k + 1);
+
+    // Tabla Peq por hilo; se deja en cero al terminar
+    thread_local std::array<std::uint64_t, 256> peq{};
+    for (std::size_t i = 0; i < m; ++i)
+        peq[static_cast<unsigned char>(pattern[i])] |= std::uint64_t(1) << i;
+
+    const std::uint64_t last = std::uint64_t(1) << (m - 1);
+    std::uint64_t pv = ~std::uint64_t(0);
+    std::uint64_t mv = 0;
+    std::size_t score = m;
+    std::size_t result = k + 1;
+
+    std::size_t j = 0;
+    while (j < n) {
+        const std::uint64_t eq = peq[static_cast<unsigned char>(text[j])];
+        const std::uint64_t xv = eq | mv;
+        const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        std::uint64_t ph = mv | ~(xh | pv);
+        std::uint64_t mh = pv & xh;
+        if (ph & last) ++score;
+        else if (mh & last) --score;
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        ++j;
+        // D[m][n] >= D[m][j] - (n - j)
+        if (score > k + (n - j)) break;
+    }
+    if (j == n && score <= k) result = score;
+
+    for (std::size_t i = 0; i < m; ++i)
+        peq[static_cast<unsigned char>(pattern[i])] = 0;
+    return result;
+}
+
+// Variante multipalabra (Hyyrö 2003): bloques de 64 filas que se pasan el
+// acarreo horizontal de arriba hacia abajo. Peq y las columnas viven en
+// buffers por hilo que solo crecen; Peq se deja en cero al terminar.
+inline std::size_t myersBlocks(std::string_view text, std::string_view pattern,
+                               std::size_t k) {
+    const std::size_t n = text.size();
+    const std::size_t m = pattern.size();
+    if (k > std::max(n, m)) k = std::max(n, m);
+    if (m == 0) return std::min(n, k + 1);
+
+    const std::size_t blocks = (m + kWord - 1) / kWord;
+    thread_local std::vector<std::uint64_t> peq, pv, mv;
+    if (pv.size() < blocks) {
+        peq.resize(blocks * 256, 0);
+        pv.resize(blocks);
+        mv.resize(blocks);
+    }
+    for (std::size_t i = 0; i < m; ++i) {
+        peq[(i / kWord) * 256 + static_cast<unsigned char>(pattern[i])] |=
+            std::uint64_t(1) << (i % kWord);
+    }
+    std::fill(pv.begin(), pv.begin() + blocks, ~std::uint64_t(0));
+    std::fill(mv.begin(), mv.begin() + blocks, 0);
+
+    const std::uint64_t high = std::uint64_t(1) << (kWord - 1);
+    const std::uint64_t last = std::uint64_t(1) << ((m - 1) % kWord);
+    std::size_t score = m;
+
+    for (std::size_t j = 0; j < n; ++j) {
+        const unsigned char c = static_cast<unsigned char>(text[j]);
+        int hin = 1;
+        for (std::size_t b = 0; b < blocks; ++b) {
+            std::uint64_t eq = peq[b * 256 + c];
+            if (hin < 0) eq |= 1;
+            const std::uint64_t xv = eq | mv[b];
+            const std::uint64_t xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+            std::uint64_t ph = mv[b] | ~(xh | pv[b]);
+            std::uint64_t mh = pv[b] & xh;
+
+            const std::uint64_t out = b + 1 == blocks ? last : high;
+            const int hout = (ph & out) ? 1 : ((mh & out) ? -1 : 0);
+
+            ph <<= 1;
+            mh <<= 1;
+            if (hin < 0) mh |= 1;
+            else if (hin > 0) ph |= 1;
+            pv[b] = mh | ~(xv | ph);
+            mv[b] = ph & xv;
+            hin = hout;
+        }
+        if (hin > 0) ++score;
+        else if (hin < 0) --score;
+        if (score > k + (n - j - 1)) {
+            score = k + 1;
+            break;
+        }
+    }
+
+    for (std::size_t i = 0; i < m; ++i)
+        peq[(i / kWord) * 256 + static_cast<unsigned char>(pattern[i])] = 0;
+    return score <= k ? score : k + 1;
+}
+
+// Elige el nucleo: con k chico frente al patron la banda suele salir en
+// pocas filas; en otro caso bits (una palabra hasta 64 caracteres).
+inline std::size_t atMost(std::string_view s1, std::string_view s2,
+                          std::size_t k) {
+    const std::string_view text = s1.size() >= s2.size() ? s1 : s2;
+    const std::string_view pattern = s1.size() >= s2.size() ? s2 : s1;
+
+    if (k > text.size()) k = text.size();
+    if (text.size() - pattern.size() > k) return k + 1;
+    if (k == 0) return text == pattern ? 0 : 1;
+
+    if (4 * (2 * k + 1) < pattern.size()) return banded(text, pattern, k);
+    if (pattern.size() <= kWord) return myers64(text, pattern, k);
+    return myersBlocks(text, pattern, k);
+}
+
+inline std::size_t distance(std::string_view a, std::string_view b) {
+    return atMost(a, b, std::max(a.size(), b.size()));
+}
+
+} // namespace levenshtein
+
+#endif // LEVENSHTEIN_H
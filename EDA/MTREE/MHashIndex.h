@@ -0,0 +1,110 @@
+#ifndef MHASH_INDEX_H
+#define MHASH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Indice de coincidencia exacta al lado del arbol: tabla abierta con sondeo
+// lineal de pares (hash de la clave, objeto). Guarda el hash completo para
+// comparar claves solo cuando los hashes coinciden. Admite claves repetidas
+// (una ranura por objeto). Metric aporta hash(view) y same(view, view).
+template <class Key, class Metric> class MHashIndex {
+public:
+  using view_type = typename Metric::view_type;
+
+  void insert(Key *object) {
+    if ((_size + 1) * 2 > _slots.size())
+      grow();
+    place({Metric::hash(Metric::view(*object)), object});
+    _size++;
+  }
+
+  // Algun objeto con clave igual a key (nullptr si no hay)
+  Key *find(view_type key) const {
+    if (_size == 0)
+      return nullptr;
+    const std::uint64_t h = Metric::hash(key);
+    for (std::size_t i = h & mask();; i = (i + 1) & mask()) {
+      const Slot &s = _slots[i];
+      if (!s.object)
+        return nullptr;
+      if (s.hash == h && Metric::same(Metric::view(*s.object), key))
+        return s.object;
+    }
+  }
+
+  // El objeto mismo (por direccion) esta en el indice
+  bool contains(const Key *object) const {
+    return _size > 0 && _slots[slotOf(object)].object;
+  }
+
+  // Quita la ranura de ese objeto; false si no estaba
+  bool erase(const Key *object) {
+    if (_size == 0)
+      return false;
+    std::size_t i = slotOf(object);
+    if (!_slots[i].object)
+      return false;
+    // Borrado hacia atras: se corren las ranuras siguientes del grupo para
+    // no dejar marcas de borrado
+    for (std::size_t j = (i + 1) & mask(); _slots[j].object;
+         j = (j + 1) & mask()) {
+      std::size_t home = _slots[j].hash & mask();
+      // j puede ocupar el hueco i si su posicion ideal no cae en (i, j]
+      if (((j - home) & mask()) >= ((j - i) & mask())) {
+        _slots[i] = _slots[j];
+        i = j;
+      }
+    }
+    _slots[i] = Slot();
+    _size--;
+    return true;
+  }
+
+  void clear() {
+    _slots.clear();
+    _size = 0;
+  }
+
+  std::size_t size() const noexcept { return _size; }
+  std::size_t bytesReserved() const noexcept {
+    return _slots.capacity() * sizeof(Slot);
+  }
+
+private:
+  struct Slot {
+    std::uint64_t hash = 0;
+    Key *object = nullptr; // nullptr = libre
+  };
+
+  std::vector<Slot> _slots; // potencia de 2, a lo mas medio llena
+  std::size_t _size = 0;
+
+  std::size_t mask() const noexcept { return _slots.size() - 1; }
+
+  // Ranura de object, o la ranura libre donde terminaria su grupo
+  std::size_t slotOf(const Key *object) const {
+    std::size_t i = Metric::hash(Metric::view(*object)) & mask();
+    while (_slots[i].object && _slots[i].object != object)
+      i = (i + 1) & mask();
+    return i;
+  }
+
+  void place(const Slot &slot) {
+    std::size_t i = slot.hash & mask();
+    while (_slots[i].object)
+      i = (i + 1) & mask();
+    _slots[i] = slot;
+  }
+
+  void grow() {
+    std::vector<Slot> old(_slots.empty() ? 16 : _slots.size() * 2);
+    old.swap(_slots);
+    for (const Slot &s : old)
+      if (s.object)
+        place(s);
+  }
+};
+
+#endif // MHASH_INDEX_H
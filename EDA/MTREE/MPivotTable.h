@@ -0,0 +1,134 @@
+#ifndef MPIVOT_TABLE_H
+#define MPIVOT_TABLE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Pivots globales estilo LAESA dentro de las hojas
+struct MPivotOptions {
+  std::size_t count = 0; // P; 0 = sin tabla
+  bool wide = false;     // celdas de 16 bits en lugar de 8
+};
+
+// P pivots elegidos una vez para todo el arbol. Cada hoja guarda, despues de
+// sus entradas, las distancias de cada entrada a los P pivots en columnas
+// (una por pivot, stride celdas), recortadas a 255 o 65535. Recortar no
+// rompe la cota: |min(a,c) - min(b,c)| <= |a - b|. Una consulta mide sus P
+// distancias una vez y descarta entradas con max_p |d(q,p) - d(o,p)|,
+// calculado de a 16 entradas para que el compilador lo vectorice.
+template <class Metric> class MPivotTable {
+public:
+  using view_type = typename Metric::view_type;
+  using distance_type = typename Metric::distance_type;
+  static constexpr std::size_t kBlock = 16;
+
+  // Distancias de la consulta a los pivots, ya recortadas al ancho de celda
+  struct Query {
+    std::vector<std::uint8_t> narrow;
+    std::vector<std::uint16_t> wide;
+  };
+
+  MPivotTable(MPivotOptions options, std::size_t capacity)
+      : _options(options),
+        _stride((capacity + kBlock - 1) / kBlock * kBlock) {
+    if (options.count && !std::is_integral<distance_type>::value)
+      throw std::invalid_argument(
+          "MPivotTable: requiere distancias enteras");
+  }
+
+  std::size_t count() const noexcept { return _options.count; }
+  bool wide() const noexcept { return _options.wide; }
+  // Las P claves ya estan elegidas y las hojas tienen sus celdas
+  bool ready() const noexcept {
+    return _options.count && _keys.size() == _options.count;
+  }
+  const std::vector<view_type> &keys() const noexcept { return _keys; }
+
+  // Bytes de tabla por slot de nodo
+  std::size_t bytes() const noexcept {
+    return _options.count * _stride * cellBytes();
+  }
+  std::size_t cellBytes() const noexcept { return _options.wide ? 2 : 1; }
+
+  void setKeys(std::vector<view_type> keys) { _keys = std::move(keys); }
+  void addKey(view_type key) { _keys.push_back(key); }
+
+  // Celdas de la entrada slot: d(key, p) para cada pivot
+  void write(view_type key, unsigned char *table, std::size_t slot) const {
+    for (std::size_t p = 0; p < _keys.size(); ++p)
+      store(table, p, slot, Metric()(_keys[p], key));
+  }
+
+  void copyRow(const unsigned char *from, std::size_t i, unsigned char *to,
+               std::size_t j) const {
+    const std::size_t cell = cellBytes();
+    for (std::size_t p = 0; p < _options.count; ++p)
+      std::memmove(to + (p * _stride + j) * cell,
+                   from + (p * _stride + i) * cell, cell);
+  }
+
+  Query measure(view_type q) const {
+    Query query;
+    for (view_type key : _keys) {
+      distance_type d = Metric()(key, q);
+      if (_options.wide)
+        query.wide.push_back(clamp<std::uint16_t>(d));
+      else
+        query.narrow.push_back(clamp<std::uint8_t>(d));
+    }
+    return query;
+  }
+
+  // Cotas inferiores de d(q, o) para las entradas [first, first + 16)
+  void bounds(const unsigned char *table, std::size_t first, const Query &q,
+              std::uint16_t out[kBlock]) const {
+    if (_options.wide)
+      blockBounds(reinterpret_cast<const std::uint16_t *>(table) + first,
+                  q.wide.data(), out);
+    else
+      blockBounds(table + first, q.narrow.data(), out);
+  }
+
+private:
+  MPivotOptions _options;
+  std::size_t _stride; // celdas por columna (capacidad redondeada a 16)
+  std::vector<view_type> _keys;
+
+  template <class Cell> static Cell clamp(distance_type d) noexcept {
+    return static_cast<Cell>(
+        std::min<distance_type>(d, std::numeric_limits<Cell>::max()));
+  }
+
+  void store(unsigned char *table, std::size_t p, std::size_t slot,
+             distance_type d) const {
+    if (_options.wide)
+      reinterpret_cast<std::uint16_t *>(table)[p * _stride + slot] =
+          clamp<std::uint16_t>(d);
+    else
+      table[p * _stride + slot] = clamp<std::uint8_t>(d);
+  }
+
+  template <class Cell>
+  void blockBounds(const Cell *column, const Cell *q,
+                   std::uint16_t out[kBlock]) const {
+    Cell lower[kBlock] = {};
+    for (std::size_t p = 0; p < _options.count; ++p, column += _stride) {
+      const Cell qp = q[p];
+      for (std::size_t j = 0; j < kBlock; ++j) {
+        Cell a = column[j];
+        Cell diff = a > qp ? Cell(a - qp) : Cell(qp - a);
+        lower[j] = std::max(lower[j], diff);
+      }
+    }
+    for (std::size_t j = 0; j < kBlock; ++j)
+      out[j] = lower[j];
+  }
+};
+
+#endif // MPIVOT_TABLE_H
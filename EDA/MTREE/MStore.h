@@ -0,0 +1,111 @@
+#ifndef MSTORE_H
+#define MSTORE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <vector>
+
+// Pool de claves: las cadenas se copian una tras otra en bloques grandes que
+// nunca se mueven, asi las vistas guardadas en los nodos siguen validas
+// mientras viva el pool.
+class StringPool {
+public:
+  explicit StringPool(std::size_t blockSize = std::size_t(1) << 20)
+      : _blockSize(blockSize), _used(0), _bytes(0), _reserved(0) {}
+
+  std::string_view add(std::string_view s) {
+    if (_blocks.empty() || _used + s.size() > _blocks.back().size) {
+      std::size_t size = std::max(_blockSize, s.size());
+      _blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+      _used = 0;
+      _reserved += size;
+    }
+    char *dst = _blocks.back().data.get() + _used;
+    if (!s.empty())
+      std::memcpy(dst, s.data(), s.size());
+    _used += s.size();
+    _bytes += s.size();
+    return std::string_view(dst, s.size());
+  }
+
+  std::size_t bytesUsed() const noexcept { return _bytes; }
+  std::size_t bytesReserved() const noexcept { return _reserved; }
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+  };
+
+  std::vector<Block> _blocks;
+  std::size_t _blockSize;
+  std::size_t _used; // bytes ocupados del ultimo bloque
+  std::size_t _bytes;
+  std::size_t _reserved;
+};
+
+// Arena de bloques de tamano fijo (slots) cortados de trozos grandes
+// alineados a linea de cache; los slots liberados se reutilizan.
+class SlotArena {
+public:
+  static constexpr std::size_t kAlign = 64;
+
+  explicit SlotArena(std::size_t slotSize, std::size_t slotsPerChunk = 64)
+      : _slotSize((slotSize + kAlign - 1) / kAlign * kAlign),
+        _perChunk(slotsPerChunk), _next(0), _live(0) {}
+
+  ~SlotArena() { clear(); }
+
+  SlotArena(const SlotArena &) = delete;
+  SlotArena &operator=(const SlotArena &) = delete;
+
+  void *allocate() {
+    _live++;
+    if (!_free.empty()) {
+      void *slot = _free.back();
+      _free.pop_back();
+      return slot;
+    }
+    if (_chunks.empty() || _next == _perChunk) {
+      _chunks.push_back(static_cast<unsigned char *>(::operator new(
+          _slotSize * _perChunk, std::align_val_t(kAlign))));
+      _next = 0;
+    }
+    return _chunks.back() + _slotSize * _next++;
+  }
+
+  void release(void *slot) {
+    _live--;
+    _free.push_back(slot);
+  }
+
+  // Libera todos los slots de una vez
+  void clear() {
+    for (unsigned char *chunk : _chunks)
+      ::operator delete(chunk, std::align_val_t(kAlign));
+    _chunks.clear();
+    _free.clear();
+    _next = 0;
+    _live = 0;
+  }
+
+  std::size_t slotSize() const noexcept { return _slotSize; }
+  std::size_t liveSlots() const noexcept { return _live; }
+  std::size_t bytesReserved() const noexcept {
+    return _chunks.size() * _perChunk * _slotSize;
+  }
+
+private:
+  std::vector<unsigned char *> _chunks;
+  std::vector<void *> _free;
+  std::size_t _slotSize;
+  std::size_t _perChunk;
+  std::size_t _next; // siguiente slot sin usar del ultimo trozo
+  std::size_t _live;
+};
+
+#endif // MSTORE_H
@@ -0,0 +1,478 @@
+#ifndef MTREE_FILE_H
+#define MTREE_FILE_H
+
+#include "Levenshtein.h"
+#include "Mtree.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Formato en disco del M-tree, pensado para mmap y consultas en el lugar:
+//
+//   [MFileHeader][nodos en preorden][pool de claves]
+//
+// Cada nodo es un MFileNode seguido de sus entradas; los hijos y las claves
+// se referencian por desplazamiento (bytes desde el inicio del archivo y
+// desde el inicio del pool). Los enteros quedan en el orden de bytes de la
+// maquina que guardo; el campo endian del header permite rechazar un archivo
+// escrito con otro orden. Todo esta alineado a 8.
+constexpr char kMFileMagic[8] = {'M', 'T', 'R', 'E', 'E', 'I', 'D', 'X'};
+constexpr std::uint32_t kMFileVersion = 1;
+constexpr std::uint32_t kMFileEndian = 0x01020304;
+
+struct MFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t endian; // kMFileEndian escrito por la maquina que guardo
+  std::uint64_t fileSize;
+  std::uint64_t checksum; // de todo lo que sigue al header
+  std::uint32_t maxEntries;
+  std::uint32_t height;
+  std::uint64_t nodes;
+  std::uint64_t entries;
+  std::uint64_t rootOffset; // 0 si el arbol esta vacio
+  std::uint64_t poolOffset;
+  std::uint64_t poolSize;
+};
+
+struct MFileNode {
+  std::uint32_t count;
+  std::uint32_t isLeaf;
+  std::uint64_t pivotKey;
+  std::uint32_t pivotKeyLength;
+  std::uint32_t parentDistance;
+  std::uint32_t radius;
+  std::uint32_t reserved;
+};
+
+struct MFileLeafEntry {
+  std::uint64_t key;
+  std::uint32_t keyLength;
+  std::uint32_t pivotDist;
+};
+
+struct MFileRoutingEntry {
+  std::uint64_t key;
+  std::uint32_t keyLength;
+  std::uint32_t pivotDist;
+  std::uint32_t radius;
+  std::uint32_t reserved;
+  std::uint64_t child;
+};
+
+static_assert(sizeof(MFileHeader) == 80, "MFileHeader cambia el formato");
+static_assert(sizeof(MFileNode) == 32, "MFileNode cambia el formato");
+static_assert(sizeof(MFileLeafEntry) == 16, "MFileLeafEntry cambia el formato");
+static_assert(sizeof(MFileRoutingEntry) == 32,
+              "MFileRoutingEntry cambia el formato");
+
+// Hash de 64 bits palabra por palabra (FNV-1a sobre bloques de 8 bytes)
+inline std::uint64_t mfileChecksum(const unsigned char *data, std::size_t n,
+                                   std::uint64_t h = 0xcbf29ce484222325ull) {
+  const std::uint64_t prime = 0x100000001b3ull;
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    h = (h ^ word) * prime;
+  }
+  for (; i < n; ++i)
+    h = (h ^ data[i]) * prime;
+  return h;
+}
+
+// Escribe tree en path. Las claves se copian al pool en el orden en que
+// aparecen en el preorden; las de ruteo reutilizan los bytes de la hoja
+// cuando comparten memoria en el arbol.
+inline void saveMTree(const MTree &tree, const std::string &path) {
+  const MNode *root = tree.root();
+
+  // Primera pasada: desplazamiento de cada nodo
+  std::vector<const MNode *> preorder;
+  std::unordered_map<const MNode *, std::uint64_t> offsetOf;
+  std::uint64_t offset = sizeof(MFileHeader);
+  std::uint32_t height = 0;
+  std::uint64_t entries = 0;
+  std::function<void(const MNode *, std::uint32_t)> layout =
+      [&](const MNode *node, std::uint32_t depth) {
+        preorder.push_back(node);
+        offsetOf[node] = offset;
+        height = std::max(height, depth + 1);
+        offset += sizeof(MFileNode);
+        if (node->isLeaf()) {
+          offset += node->size() * sizeof(MFileLeafEntry);
+          entries += node->size();
+          return;
+        }
+        offset += node->size() * sizeof(MFileRoutingEntry);
+        for (const MNode *child : node->children())
+          layout(child, depth + 1);
+      };
+  if (root)
+    layout(root, 0);
+  const std::uint64_t poolOffset = offset;
+
+  // Se deduplica por (puntero, largo): una clave vacia del StringPool
+  // comparte puntero con la siguiente
+  using View = std::pair<const char *, std::size_t>;
+  struct ViewHash {
+    std::size_t operator()(const View &v) const {
+      return std::hash<const char *>()(v.first) ^ v.second;
+    }
+  };
+  std::string pool;
+  std::unordered_map<View, std::uint64_t, ViewHash> keyOffset;
+  auto intern = [&](std::string_view key) {
+    auto it = keyOffset.find({key.data(), key.size()});
+    if (it != keyOffset.end())
+      return it->second;
+    std::uint64_t at = pool.size();
+    pool.append(key.data(), key.size());
+    keyOffset.emplace(View(key.data(), key.size()), at);
+    return at;
+  };
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    throw std::runtime_error("saveMTree: no se pudo abrir " + path);
+
+  MFileHeader header{};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  std::uint64_t checksum = 0xcbf29ce484222325ull;
+  std::vector<unsigned char> buffer;
+  for (const MNode *node : preorder) {
+    buffer.clear();
+    auto put = [&](const void *p, std::size_t n) {
+      const unsigned char *bytes = static_cast<const unsigned char *>(p);
+      buffer.insert(buffer.end(), bytes, bytes + n);
+    };
+
+    MFileNode rec{};
+    rec.count = static_cast<std::uint32_t>(node->size());
+    rec.isLeaf = node->isLeaf();
+    rec.pivotKey = intern(node->pivotKey());
+    rec.pivotKeyLength = static_cast<std::uint32_t>(node->pivotKey().size());
+    rec.parentDistance = static_cast<std::uint32_t>(node->parentDistance());
+    rec.radius = static_cast<std::uint32_t>(node->radius());
+    put(&rec, sizeof(rec));
+
+    for (std::size_t i = 0; i < node->size(); ++i) {
+      if (node->isLeaf()) {
+        const MLeafEntry &e = node->leafEntries()[i];
+        MFileLeafEntry fe{intern(e.key),
+                          static_cast<std::uint32_t>(e.key.size()),
+                          e.pivotDist};
+        put(&fe, sizeof(fe));
+      } else {
+        const MRoutingEntry &e = node->routingEntries()[i];
+        MFileRoutingEntry fe{intern(e.key),
+                             static_cast<std::uint32_t>(e.key.size()),
+                             e.pivotDist, e.radius, 0, offsetOf[e.child]};
+        put(&fe, sizeof(fe));
+      }
+    }
+    checksum = mfileChecksum(buffer.data(), buffer.size(), checksum);
+    out.write(reinterpret_cast<const char *>(buffer.data()),
+              static_cast<std::streamsize>(buffer.size()));
+  }
+  // Los registros miden multiplos de 8, asi encadenar el hash por nodo da lo
+  // mismo que el hash de una pasada que hace el lector
+  checksum = mfileChecksum(reinterpret_cast<const unsigned char *>(pool.data()),
+                           pool.size(), checksum);
+  out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+
+  std::memcpy(header.magic, kMFileMagic, sizeof(header.magic));
+  header.version = kMFileVersion;
+  header.endian = kMFileEndian;
+  header.fileSize = poolOffset + pool.size();
+  header.checksum = checksum;
+  header.maxEntries = static_cast<std::uint32_t>(tree.maxEntries());
+  header.height = height;
+  header.nodes = preorder.size();
+  header.entries = entries;
+  header.rootOffset = root ? sizeof(MFileHeader) : 0;
+  header.poolOffset = poolOffset;
+  header.poolSize = pool.size();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!out)
+    throw std::runtime_error("saveMTree: error al escribir " + path);
+}
+
+// Arbol guardado con saveMTree y abierto con mmap: abrir solo valida el
+// header, asi el arranque no depende del tamano del archivo. Las consultas
+// leen el archivo en el lugar y comprueban los limites de cada nodo y clave
+// que tocan; un archivo alterado lanza runtime_error en vez de leer fuera del
+// mapeo. verifyChecksum recorre todo el archivo al abrir y es opcional. Los
+// resultados son vistas al pool, validas mientras viva el objeto.
+class MappedMTree {
+public:
+  explicit MappedMTree(const std::string &path, bool verifyChecksum = false) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("MappedMTree: no se pudo abrir " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 ||
+        static_cast<std::size_t>(st.st_size) < sizeof(MFileHeader)) {
+      ::close(fd);
+      throw std::runtime_error("MappedMTree: archivo truncado " + path);
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+    void *map = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      throw std::runtime_error("MappedMTree: mmap fallo en " + path);
+    _base = static_cast<const unsigned char *>(map);
+
+    try {
+      validate(verifyChecksum);
+    } catch (...) {
+      ::munmap(const_cast<unsigned char *>(_base), _size);
+      throw;
+    }
+    _pool = reinterpret_cast<const char *>(_base + header().poolOffset);
+  }
+
+  ~MappedMTree() { ::munmap(const_cast<unsigned char *>(_base), _size); }
+
+  MappedMTree(const MappedMTree &) = delete;
+  MappedMTree &operator=(const MappedMTree &) = delete;
+
+  const MFileHeader &header() const noexcept {
+    return *reinterpret_cast<const MFileHeader *>(_base);
+  }
+  std::size_t size() const noexcept { return header().entries; }
+
+  bool search(std::string_view key, MQueryStats *stats = nullptr) const {
+    for (std::string_view s : rangeSearch(key, 0, stats))
+      if (s == key)
+        return true;
+    return false;
+  }
+
+  std::vector<std::string_view> rangeSearch(std::string_view query,
+                                            std::size_t searchRadius,
+                                            MQueryStats *stats = nullptr) const {
+    std::vector<std::string_view> result;
+    if (!header().rootOffset)
+      return result;
+    MQueryStats localStats;
+    MQueryStats &st = stats ? *stats : localStats;
+
+    const MFileNode *root = nodeAt(header().rootOffset, 0);
+    std::size_t reach = searchRadius + root->radius;
+    std::size_t d =
+        levenshtein::atMost(key(root->pivotKey, root->pivotKeyLength), query,
+                            reach);
+    st.distanceComputations++;
+    if (d <= reach)
+      rangeSearchFrom(root, query, searchRadius, d, result, st);
+    return result;
+  }
+
+  // Mismo recorrido best-first que MTree::kNearestNeighbors
+  std::vector<std::string_view>
+  kNearestNeighbors(std::string_view query, std::size_t k,
+                    MQueryStats *stats = nullptr) const {
+    if (!header().rootOffset || k == 0)
+      return {};
+    MQueryStats localStats;
+    MQueryStats &st = stats ? *stats : localStats;
+
+    struct Pending {
+      std::size_t minDist;
+      std::size_t pivotDist;
+      const MFileNode *node;
+      bool operator>(const Pending &other) const {
+        return minDist > other.minDist;
+      }
+    };
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>>
+        pending;
+    std::priority_queue<std::pair<std::size_t, std::string_view>> best;
+    auto bound = [&]() -> std::size_t {
+      return best.size() < k ? SIZE_MAX : best.top().first;
+    };
+
+    const MFileNode *root = nodeAt(header().rootOffset, 0);
+    std::size_t rootDist = levenshtein::distance(
+        key(root->pivotKey, root->pivotKeyLength), query);
+    st.distanceComputations++;
+    pending.push(
+        {rootDist > root->radius ? rootDist - root->radius : 0, rootDist, root});
+
+    while (!pending.empty()) {
+      Pending cur = pending.top();
+      pending.pop();
+      if (cur.minDist >= bound())
+        break;
+
+      const MFileNode *node = cur.node;
+      st.nodesVisited++;
+      if (node->isLeaf) {
+        const MFileLeafEntry *e = leafEntries(node);
+        for (std::size_t i = 0; i < node->count; ++i) {
+          if (absDiff(cur.pivotDist, e[i].pivotDist) >= bound()) {
+            st.distancesAvoided++;
+            continue;
+          }
+          std::string_view s = key(e[i].key, e[i].keyLength);
+          std::size_t dist = best.size() < k
+                                 ? levenshtein::distance(s, query)
+                                 : levenshtein::atMost(s, query, bound() - 1);
+          st.distanceComputations++;
+          if (best.size() < k) {
+            best.push({dist, s});
+          } else if (dist < best.top().first) {
+            best.pop();
+            best.push({dist, s});
+          }
+        }
+        continue;
+      }
+
+      const MFileRoutingEntry *e = routingEntries(node);
+      for (std::size_t i = 0; i < node->count; ++i) {
+        std::size_t lower = absDiff(cur.pivotDist, e[i].pivotDist);
+        lower = lower > e[i].radius ? lower - e[i].radius : 0;
+        if (lower >= bound()) {
+          st.distancesAvoided++;
+          continue;
+        }
+        std::string_view s = key(e[i].key, e[i].keyLength);
+        std::size_t dist =
+            best.size() < k
+                ? levenshtein::distance(s, query)
+                : levenshtein::atMost(s, query, bound() + e[i].radius - 1);
+        st.distanceComputations++;
+        std::size_t minDist = dist > e[i].radius ? dist - e[i].radius : 0;
+        if (minDist < bound())
+          pending.push({minDist, dist, nodeAt(e[i].child, offsetOf(node))});
+      }
+    }
+
+    std::vector<std::string_view> kRes(best.size());
+    std::size_t idx = best.size();
+    while (!best.empty()) {
+      kRes[--idx] = best.top().second;
+      best.pop();
+    }
+    return kRes;
+  }
+
+private:
+  const unsigned char *_base = nullptr;
+  std::size_t _size = 0;
+  const char *_pool = nullptr;
+
+  void validate(bool verifyChecksum) const {
+    const MFileHeader &h = header();
+    if (std::memcmp(h.magic, kMFileMagic, sizeof(h.magic)) != 0)
+      throw std::runtime_error("MappedMTree: no es un archivo de M-tree");
+    if (h.version != kMFileVersion)
+      throw std::runtime_error("MappedMTree: version " +
+                               std::to_string(h.version) + " no soportada");
+    if (h.endian != kMFileEndian)
+      throw std::runtime_error("MappedMTree: orden de bytes distinto");
+    if (h.fileSize != _size || h.poolOffset > _size ||
+        h.poolSize != _size - h.poolOffset ||
+        (h.rootOffset && h.rootOffset + sizeof(MFileNode) > h.poolOffset))
+      throw std::runtime_error("MappedMTree: tamanos inconsistentes");
+    if (verifyChecksum &&
+        mfileChecksum(_base + sizeof(MFileHeader),
+                      _size - sizeof(MFileHeader)) != h.checksum)
+      throw std::runtime_error("MappedMTree: checksum invalido");
+  }
+
+  // Sin checksum un archivo truncado o alterado todavia pasa el header, asi
+  // que cada nodo y clave se valida al tocarlo: cuesta unas comparaciones por
+  // acceso en lugar de recorrer el archivo al abrir. En preorden cada hijo
+  // esta despues de su padre, asi un desplazamiento que no avanza delata un
+  // ciclo.
+  [[noreturn]] static void corrupt(const char *what) {
+    throw std::runtime_error(std::string("MappedMTree: ") + what);
+  }
+
+  const MFileNode *nodeAt(std::uint64_t offset, std::uint64_t parent) const {
+    const std::uint64_t end = header().poolOffset;
+    if (offset <= parent || offset % 8 || offset < sizeof(MFileHeader) ||
+        offset > end || end - offset < sizeof(MFileNode))
+      corrupt("desplazamiento de nodo invalido");
+    const MFileNode *node = reinterpret_cast<const MFileNode *>(_base + offset);
+    const std::uint64_t entrySize = node->isLeaf ? sizeof(MFileLeafEntry)
+                                                 : sizeof(MFileRoutingEntry);
+    if (node->isLeaf > 1 ||
+        node->count * entrySize > end - offset - sizeof(MFileNode))
+      corrupt("nodo con entradas fuera del archivo");
+    return node;
+  }
+  std::uint64_t offsetOf(const MFileNode *node) const {
+    return static_cast<std::uint64_t>(
+        reinterpret_cast<const unsigned char *>(node) - _base);
+  }
+  static const MFileLeafEntry *leafEntries(const MFileNode *node) {
+    return reinterpret_cast<const MFileLeafEntry *>(node + 1);
+  }
+  static const MFileRoutingEntry *routingEntries(const MFileNode *node) {
+    return reinterpret_cast<const MFileRoutingEntry *>(node + 1);
+  }
+  std::string_view key(std::uint64_t offset, std::uint32_t length) const {
+    const std::uint64_t poolSize = header().poolSize;
+    if (offset > poolSize || length > poolSize - offset)
+      corrupt("clave fuera del pool");
+    return std::string_view(_pool + offset, length);
+  }
+
+  void rangeSearchFrom(const MFileNode *node, std::string_view query,
+                       std::size_t searchRadius, std::size_t pivotDist,
+                       std::vector<std::string_view> &result,
+                       MQueryStats &st) const {
+    st.nodesVisited++;
+    if (node->isLeaf) {
+      const MFileLeafEntry *e = leafEntries(node);
+      for (std::size_t i = 0; i < node->count; ++i) {
+        if (absDiff(pivotDist, e[i].pivotDist) > searchRadius) {
+          st.distancesAvoided++;
+          continue;
+        }
+        st.distanceComputations++;
+        std::string_view s = key(e[i].key, e[i].keyLength);
+        if (levenshtein::atMost(s, query, searchRadius) <= searchRadius)
+          result.push_back(s);
+      }
+      return;
+    }
+
+    const MFileRoutingEntry *e = routingEntries(node);
+    for (std::size_t i = 0; i < node->count; ++i) {
+      std::size_t reach = searchRadius + e[i].radius;
+      if (absDiff(pivotDist, e[i].pivotDist) > reach) {
+        st.distancesAvoided++;
+        continue;
+      }
+      st.distanceComputations++;
+      std::size_t d =
+          levenshtein::atMost(key(e[i].key, e[i].keyLength), query, reach);
+      if (d <= reach)
+        rangeSearchFrom(nodeAt(e[i].child, offsetOf(node)), query, searchRadius,
+                        d, result, st);
+    }
+  }
+};
+
+#endif // MTREE_FILE_H
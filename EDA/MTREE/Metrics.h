@@ -0,0 +1,221 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "Levenshtein.h"
+#include "MStore.h"
+#include "Object.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Una metrica de BasicMTree<Key, Metric> es un functor sin estado con:
+//   view_type      lo que guardan las entradas (barato de copiar)
+//   distance_type  entero sin signo o flotante
+//   store_type     donde viven las claves que el arbol copia
+//   static view_type view(const Key &)                  para consultas
+//   static view_type store(const Key &, store_type &)   para las entradas
+//   distance_type operator()(view_type, view_type) const
+//   distance_type atMost(view_type, view_type, distance_type k) const
+//       exacta si es <= k; en otro caso cualquier valor > k
+//   static std::uint64_t hash(view_type)     para el indice exacto
+//   static bool same(view_type, view_type)   claves iguales (distancia 0)
+
+// Operaciones sobre distancias. Con enteros "menor que b" es "a lo mas
+// b - 1", asi los kernels acotados reciben una cota mas ajustada.
+template <class D> struct MDistance {
+  static constexpr D infinity() noexcept {
+    return std::numeric_limits<D>::has_infinity
+               ? std::numeric_limits<D>::infinity()
+               : std::numeric_limits<D>::max();
+  }
+  static D absDiff(D a, D b) noexcept { return a > b ? a - b : b - a; }
+  // a - b sin bajar de cero
+  static D minus(D a, D b) noexcept { return a > b ? a - b : D(0); }
+  // Cota para atMost cuando solo interesa un valor < b (b > 0)
+  static D below(D b) noexcept {
+    if constexpr (std::is_integral<D>::value)
+      return b - 1;
+    else
+      return b;
+  }
+};
+
+// Combina v en el hash h (hashes de vectores)
+inline std::uint64_t mixHash(std::uint64_t h, std::uint64_t v) noexcept {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  return h;
+}
+
+// Claves que se quedan donde estan: el arbol guarda punteros a ellas
+struct PointerStore {
+  std::size_t bytesReserved() const noexcept { return 0; }
+};
+
+// Edicion sobre cadenas; las claves se copian al StringPool del arbol
+struct LevenshteinMetric {
+  using view_type = std::string_view;
+  using distance_type = std::uint32_t;
+  using store_type = StringPool;
+
+  static view_type view(const Object &o) noexcept { return o.str(); }
+  static view_type view(const std::string &s) noexcept { return s; }
+  template <class Key>
+  static view_type store(const Key &k, StringPool &pool) {
+    return pool.add(view(k));
+  }
+
+  distance_type operator()(view_type a, view_type b) const {
+    return static_cast<distance_type>(levenshtein::distance(a, b));
+  }
+  distance_type atMost(view_type a, view_type b, distance_type k) const {
+    return static_cast<distance_type>(levenshtein::atMost(a, b, k));
+  }
+
+  static std::uint64_t hash(view_type k) noexcept {
+    return std::hash<std::string_view>()(k);
+  }
+  static bool same(view_type a, view_type b) noexcept { return a == b; }
+};
+
+// Posiciones distintas entre codigos de barras de largo fijo; si los largos
+// difieren, cada posicion sobrante cuenta como distinta
+struct HammingMetric {
+  using view_type = std::string_view;
+  using distance_type = std::uint32_t;
+  using store_type = StringPool;
+
+  static view_type view(const std::string &s) noexcept { return s; }
+  static view_type store(const std::string &s, StringPool &pool) {
+    return pool.add(s);
+  }
+
+  distance_type operator()(view_type a, view_type b) const {
+    return atMost(a, b, std::numeric_limits<distance_type>::max() - 1);
+  }
+  distance_type atMost(view_type a, view_type b, distance_type k) const {
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t d = std::max(a.size(), b.size()) - n;
+    for (std::size_t i = 0; i < n && d <= k; ++i)
+      d += a[i] != b[i];
+    return static_cast<distance_type>(std::min<std::size_t>(d, k + 1));
+  }
+
+  static std::uint64_t hash(view_type k) noexcept {
+    return std::hash<std::string_view>()(k);
+  }
+  static bool same(view_type a, view_type b) noexcept { return a == b; }
+};
+
+// 1 - |A n B| / |A u B| sobre conjuntos de tokens (vectores ordenados y sin
+// repetidos)
+struct JaccardMetric {
+  using Key = std::vector<std::uint32_t>;
+  using view_type = const Key *;
+  using distance_type = double;
+  using store_type = PointerStore;
+
+  static view_type view(const Key &k) noexcept { return &k; }
+  static view_type store(const Key &k, PointerStore &) noexcept { return &k; }
+
+  distance_type operator()(view_type a, view_type b) const {
+    std::size_t common = 0;
+    auto i = a->begin(), j = b->begin();
+    while (i != a->end() && j != b->end()) {
+      if (*i < *j) {
+        ++i;
+      } else if (*j < *i) {
+        ++j;
+      } else {
+        ++common;
+        ++i;
+        ++j;
+      }
+    }
+    const std::size_t all = a->size() + b->size() - common;
+    return all ? 1.0 - double(common) / double(all) : 0.0;
+  }
+  distance_type atMost(view_type a, view_type b, distance_type) const {
+    return (*this)(a, b);
+  }
+
+  static std::uint64_t hash(view_type k) noexcept {
+    std::uint64_t h = k->size();
+    for (std::uint32_t token : *k)
+      h = mixHash(h, token);
+    return h;
+  }
+  static bool same(view_type a, view_type b) noexcept { return *a == *b; }
+};
+
+// Euclidiana sobre embeddings; atMost corta cuando la suma parcial ya
+// supera k^2
+struct L2Metric {
+  using Key = std::vector<float>;
+  using view_type = const Key *;
+  using distance_type = float;
+  using store_type = PointerStore;
+
+  static view_type view(const Key &k) noexcept { return &k; }
+  static view_type store(const Key &k, PointerStore &) noexcept { return &k; }
+
+  distance_type operator()(view_type a, view_type b) const {
+    return atMost(a, b, std::numeric_limits<float>::infinity());
+  }
+  distance_type atMost(view_type a, view_type b, distance_type k) const {
+    const std::size_t n = std::min(a->size(), b->size());
+    const float *pa = a->data();
+    const float *pb = b->data();
+    const float limit = k * k;
+    // Ocho sumas parciales para que el compilador vectorice; se revisa la
+    // cota cada 64 componentes
+    float lanes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      for (std::size_t j = 0; j < 8; ++j) {
+        float diff = pa[i + j] - pb[i + j];
+        lanes[j] += diff * diff;
+      }
+      if ((i & 63) == 56) {
+        float partial = 0;
+        for (float l : lanes)
+          partial += l;
+        if (partial > limit)
+          return std::sqrt(partial);
+      }
+    }
+    float sum = 0;
+    for (float l : lanes)
+      sum += l;
+    for (; i < n; ++i) {
+      float diff = pa[i] - pb[i];
+      sum += diff * diff;
+    }
+    return std::sqrt(sum);
+  }
+
+  // -0.0f + 0.0f = +0.0f: las dos formas del cero dan el mismo hash
+  static std::uint64_t hash(view_type k) noexcept {
+    std::uint64_t h = k->size();
+    for (float x : *k) {
+      float normalized = x + 0.0f;
+      std::uint32_t bits;
+      std::memcpy(&bits, &normalized, sizeof(bits));
+      h = mixHash(h, bits);
+    }
+    return h;
+  }
+  static bool same(view_type a, view_type b) noexcept { return *a == *b; }
+};
+
+#endif // METRICS_H
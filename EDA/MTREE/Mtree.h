@@ -1,375 +1,1904 @@
 #ifndef MTREE_H
 #define MTREE_H
 
+#include "MHashIndex.h"
+#include "MPivotTable.h"
+#include "MStore.h"
+#include "Metrics.h"
 #include "Object.h"
 #include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <queue>
 #include <random>
 #include <set>
 #include <stack>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
-class MNode {
+// Contadores por consulta
+struct MQueryStats {
+  std::size_t distanceComputations = 0;
+  // Distancias descartadas por desigualdad triangular sin calcularlas
+  std::size_t distancesAvoided = 0;
+  // Nodos cuyas entradas se recorrieron
+  std::size_t nodesVisited = 0;
+
+  MQueryStats &operator+=(const MQueryStats &other) noexcept {
+    distanceComputations += other.distanceComputations;
+    distancesAvoided += other.distancesAvoided;
+    nodesVisited += other.nodesVisited;
+    return *this;
+  }
+};
+
+// Politicas de division de nodos
+enum class PromotePolicy {
+  MaxDistance,  // par mas lejano, O(M^2) distancias
+  Random,       // dos entradas al azar
+  SampledMMRad, // mM_RAD sobre pares muestreados
+  MLBDist       // conserva el pivot y promueve la entrada mas lejana (cache)
+};
+
+enum class PartitionPolicy {
+  Hyperplane, // cada entrada al pivot mas cercano
+  Balanced    // los pivots toman por turnos su entrada mas cercana
+};
+
+struct SplitPolicy {
+  PromotePolicy promote = PromotePolicy::MaxDistance;
+  PartitionPolicy partition = PartitionPolicy::Hyperplane;
+  std::size_t samples = 8; // pares evaluados por SampledMMRad
+};
+
+struct MSplitStats {
+  std::size_t splits = 0;
+  std::size_t distanceComputations = 0;
+};
+
+struct SplitContext {
+  SplitPolicy policy;
+  MSplitStats stats;
+  std::mt19937 rng{2024};
+};
+
+template <class Key, class Metric> class BasicMNode;
+class ConcurrentMTree;
+
+// Insercion copy-on-write: cada nodo del camino se copia antes de
+// modificarse y el original queda en replaced hasta que ningun lector lo use.
+template <class Node> struct MCopyOnWrite {
+  std::vector<Node *> replaced;
+};
+
+inline std::size_t absDiff(std::size_t a, std::size_t b) noexcept {
+  return a > b ? a - b : b - a;
+}
+
+// Entradas de los nodos: la clave (en el store del arbol), la distancia al
+// pivot del nodo y, en las de ruteo, el radio del hijo quedan juntas para
+// que recorrer un nodo no tenga que saltar a los hijos ni a los objetos.
+template <class Key, class Metric> struct BasicLeafEntry {
+  typename Metric::view_type key;
+  typename Metric::distance_type pivotDist; // d(pivot del nodo, objeto)
+  Key *object;
+
+  typename Metric::view_type keyView() const noexcept { return key; }
+};
+
+template <class Key, class Metric> struct BasicRoutingEntry {
+  typename Metric::view_type key;           // clave del pivot del hijo
+  typename Metric::distance_type pivotDist; // d(pivot del nodo, pivot del hijo)
+  typename Metric::distance_type radius;    // radio de cobertura del hijo
+  BasicMNode<Key, Metric> *child;
+
+  typename Metric::view_type keyView() const noexcept { return key; }
+};
+
+// Vista de solo lectura sobre un campo de las entradas de un nodo
+template <class Entry, class T, T Entry::*Field> class MEntryView {
 public:
-  explicit MNode(bool leaf, MNode *parent = nullptr)
-      : _parent(parent), _isLeaf(leaf), _pivot(nullptr), _parentDistance(0),
-        _radius(0) {}
-  explicit MNode(MNode *parent, bool leaf, Object *pivot,
-                 std::size_t parentDistance, std::size_t radius)
-      : _parent(parent), _isLeaf(leaf), _pivot(pivot),
-        _parentDistance(parentDistance), _radius(radius) {}
-
-  ~MNode() {
-    std::size_t i = 0;
-    while (i < _children.size()) {
-      delete _children[i];
-      i++;
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    explicit iterator(const Entry *e = nullptr) : _e(e) {}
+    reference operator*() const { return _e->*Field; }
+    iterator &operator++() {
+      ++_e;
+      return *this;
+    }
+    iterator operator++(int) { return iterator(_e++); }
+    bool operator==(const iterator &o) const { return _e == o._e; }
+    bool operator!=(const iterator &o) const { return _e != o._e; }
+
+  private:
+    const Entry *_e;
+  };
+
+  MEntryView(const Entry *first, std::size_t n) : _first(first), _n(n) {}
+
+  iterator begin() const { return iterator(_first); }
+  iterator end() const { return iterator(_first + _n); }
+  std::size_t size() const noexcept { return _n; }
+  bool empty() const noexcept { return _n == 0; }
+  const T &operator[](std::size_t i) const { return _first[i].*Field; }
+
+private:
+  const Entry *_first;
+  std::size_t _n;
+};
+
+// Los nodos viven en slots de tamano fijo de una SlotArena: cabecera y
+// entradas en el mismo bloque, sin vectores aparte. Key es el tipo de los
+// objetos indexados y Metric la distancia (ver Metrics.h).
+template <class Key, class Metric> class BasicMNode {
+public:
+  using view_type = typename Metric::view_type;
+  using distance_type = typename Metric::distance_type;
+  using LeafEntry = BasicLeafEntry<Key, Metric>;
+  using RoutingEntry = BasicRoutingEntry<Key, Metric>;
+  using ObjectView = MEntryView<LeafEntry, Key *, &LeafEntry::object>;
+  using ChildView =
+      MEntryView<RoutingEntry, BasicMNode *, &RoutingEntry::child>;
+
+  class PivotDistances {
+  public:
+    explicit PivotDistances(const BasicMNode *node) : _node(node) {}
+    std::size_t size() const noexcept { return _node->_count; }
+    distance_type operator[](std::size_t i) const {
+      return _node->_isLeaf ? _node->leafEntries()[i].pivotDist
+                            : _node->routingEntries()[i].pivotDist;
     }
+
+  private:
+    const BasicMNode *_node;
+  };
+
+  using PivotTable = MPivotTable<Metric>;
+
+  // Bytes de un slot para nodos de hasta capacity entradas, mas tableBytes
+  // de la tabla de pivots (ver MPivotTable)
+  static std::size_t slotSize(std::size_t capacity,
+                              std::size_t tableBytes = 0) noexcept {
+    return sizeof(BasicMNode) + capacity * kEntryBytes + tableBytes;
+  }
+
+  // table es la tabla de pivots del arbol (nullptr si no tiene); el slot
+  // debe tener lugar para ella
+  static BasicMNode *create(SlotArena &arena, std::size_t capacity,
+                            bool leaf, BasicMNode *parent, Key *pivot,
+                            view_type pivotKey,
+                            const PivotTable *table = nullptr) {
+    BasicMNode *node = new (arena.allocate())
+        BasicMNode(arena, capacity, leaf, parent, pivot, pivotKey, table);
+    if (leaf && table && table->count())
+      std::memset(node->pivotCells(), 0, table->bytes());
+    return node;
+  }
+
+  BasicMNode(const BasicMNode &) = delete;
+  BasicMNode &operator=(const BasicMNode &) = delete;
+
+  // Copia cabecera y entradas en un slot nuevo; los hijos pasan a apuntar a
+  // la copia (los lectores no usan _parent).
+  BasicMNode *copy() const {
+    BasicMNode *dup = create(*_arena, _capacity, _isLeaf, _parent, _pivot,
+                             _pivotKey, _table);
+    dup->_count = _count;
+    dup->_parentDistance = _parentDistance;
+    dup->_radius = _radius;
+    if (_isLeaf) {
+      std::copy(leafEntries(), leafEntries() + _count, dup->leafEntries());
+      if (_table && _table->count())
+        std::memcpy(dup->pivotCells(), pivotCells(), _table->bytes());
+    } else {
+      std::copy(routingEntries(), routingEntries() + _count,
+                dup->routingEntries());
+      for (size_t i = 0; i < _count; ++i)
+        dup->routingEntries()[i].child->_parent = dup;
+    }
+    return dup;
+  }
+
+  // Devuelve el slot a la arena (no toca los hijos)
+  static void release(BasicMNode *node) {
+    SlotArena &arena = *node->_arena;
+    node->~BasicMNode();
+    arena.release(node);
   }
 
   bool isLeaf() const noexcept { return _isLeaf; }
-  MNode *parent() const noexcept { return _parent; }
-  Object *pivot() const noexcept { return _pivot; }
-  std::size_t parentDistance() const noexcept { return _parentDistance; }
-  std::size_t radius() const noexcept { return _radius; }
-  const std::vector<Object *> &objects() const noexcept { return _objects; }
-  const std::vector<MNode *> &children() const noexcept { return _children; }
-  const std::vector<std::size_t> &pivotDistances() const noexcept {
-    return _pivotDist;
-  }
-
-  void setPivot(Object *pivot) noexcept { _pivot = pivot; }
-  void setParentDistance(std::size_t distance) noexcept {
+  BasicMNode *parent() const noexcept { return _parent; }
+  Key *pivot() const noexcept { return _pivot; }
+  view_type pivotKey() const noexcept { return _pivotKey; }
+  distance_type parentDistance() const noexcept { return _parentDistance; }
+  distance_type radius() const noexcept { return _radius; }
+  ObjectView objects() const noexcept {
+    return ObjectView(leafEntries(), _isLeaf ? _count : 0);
+  }
+  ChildView children() const noexcept {
+    return ChildView(routingEntries(), _isLeaf ? 0 : _count);
+  }
+  PivotDistances pivotDistances() const noexcept {
+    return PivotDistances(this);
+  }
+  const LeafEntry *leafEntries() const noexcept {
+    return reinterpret_cast<const LeafEntry *>(this + 1);
+  }
+  const RoutingEntry *routingEntries() const noexcept {
+    return reinterpret_cast<const RoutingEntry *>(this + 1);
+  }
+  // Tabla de pivots de una hoja (columnas de celdas tras las entradas)
+  const PivotTable *pivotTable() const noexcept { return _table; }
+  const unsigned char *pivotCells() const noexcept {
+    return reinterpret_cast<const unsigned char *>(this + 1) +
+           _capacity * kEntryBytes;
+  }
+
+  void setPivot(Key *pivot, view_type key) noexcept {
+    _pivot = pivot;
+    _pivotKey = key;
+  }
+  void setParentDistance(distance_type distance) noexcept {
     _parentDistance = distance;
   }
-  void setRadius(std::size_t radius) noexcept { _radius = radius; }
-  void setIsLeaf(bool isLeaf) noexcept { _isLeaf = isLeaf; }
-  void setParent(MNode *parent) noexcept { _parent = parent; }
-  void setObjects(const std::vector<Object *> &objects) noexcept {
-    _objects = objects;
+  void setRadius(distance_type radius) noexcept { _radius = radius; }
+  void setParent(BasicMNode *parent) noexcept { _parent = parent; }
+
+  size_t size() const noexcept { return _count; }
+
+  // key debe vivir en el store del arbol. Con tabla de pivots lista se
+  // miden las P distancias de la entrada.
+  void appendObject(Key *obj, view_type key, distance_type pivotDist) {
+    if (hasPivotCells())
+      _table->write(key, pivotCells(), _count);
+    pushObject(obj, key, pivotDist);
   }
-  void setChildren(const std::vector<MNode *> &children) noexcept {
-    _children = children;
+
+  // Como appendObject, pero copia las celdas de la entrada i de from (puede
+  // ser este mismo nodo si i >= size()) en lugar de medirlas
+  void appendObject(Key *obj, view_type key, distance_type pivotDist,
+                    const BasicMNode &from, size_t i) {
+    if (hasPivotCells())
+      _table->copyRow(from.pivotCells(), i, pivotCells(), _count);
+    pushObject(obj, key, pivotDist);
   }
-  void setPivotDistances(const std::vector<std::size_t> &distances) noexcept {
-    _pivotDist = distances;
+
+  // Mide las celdas de todas las entradas (al quedar lista la tabla)
+  void writePivotCells() {
+    if (hasPivotCells())
+      for (size_t i = 0; i < _count; ++i)
+        _table->write(leafEntries()[i].key, pivotCells(), i);
   }
 
-  size_t size() const noexcept {
-    return _isLeaf ? _objects.size() : _children.size();
+  void appendChild(BasicMNode *child, distance_type pivotDist) {
+    reserveSlot();
+    child->_parent = this;
+    child->_parentDistance = pivotDist;
+    new (routingEntries() + _count)
+        RoutingEntry{child->_pivotKey, pivotDist, child->_radius, child};
+    _count++;
+    if (pivotDist + child->_radius > _radius)
+      _radius = pivotDist + child->_radius;
   }
 
+  // Las entradas guardan pivotDist (y el radio de los hijos), asi que no
+  // hace falta calcular distancias
   void updateRadius() {
     _radius = 0;
-    if (!_pivot)
-      return;
-
     if (_isLeaf) {
-      size_t idx = 0;
-      while (idx < _objects.size()) {
-        size_t dist = _pivot->distance(*_objects[idx]);
-        if (dist > _radius) {
-          _radius = dist;
-        }
-        idx++;
-      }
+      for (size_t i = 0; i < _count; ++i)
+        _radius = std::max(_radius, leafEntries()[i].pivotDist);
     } else {
-      size_t i = 0;
-      while (i < _children.size()) {
-        if (_children[i]->_pivot) {
-          size_t dist =
-              _pivot->distance(*_children[i]->_pivot) + _children[i]->_radius;
-          if (dist > _radius) {
-            _radius = dist;
-          }
-        }
-        i++;
+      for (size_t i = 0; i < _count; ++i) {
+        const RoutingEntry &e = routingEntries()[i];
+        _radius = std::max<distance_type>(_radius, e.pivotDist + e.radius);
       }
     }
   }
 
-  void updatePivotDistances() {
-    if (_isLeaf || !_pivot)
-      return;
+  // Quita la entrada i; la ultima pasa a ocupar su lugar. El radio sigue
+  // siendo una cota valida y se ajusta despues con updateRadius.
+  void removeEntry(size_t i) {
+    if (hasPivotCells())
+      _table->copyRow(pivotCells(), _count - 1, pivotCells(), i);
+    if (_isLeaf)
+      leafEntries()[i] = leafEntries()[_count - 1];
+    else
+      routingEntries()[i] = routingEntries()[_count - 1];
+    _count--;
+  }
 
-    _pivotDist.clear();
+  // Posicion de child entre las entradas (size() si no es hijo de este nodo)
+  size_t childIndex(const BasicMNode *child) const noexcept {
     size_t i = 0;
-    while (i < _children.size()) {
-      if (_children[i]->_pivot) {
-        _pivotDist.push_back(_pivot->distance(*_children[i]->_pivot));
-      }
+    while (i < _count && routingEntries()[i].child != child)
       i++;
-    }
+    return i;
   }
 
-  bool insert(const Object &obj, size_t maxEntries) {
+  // Copia en la entrada idx el radio actual de su hijo
+  void syncChildRadius(size_t idx) noexcept {
+    routingEntries()[idx].radius = routingEntries()[idx].child->_radius;
+  }
+
+  // Recalcula las distancias al pivot (p. ej. tras setPivot)
+  void updatePivotDistances() {
     if (_isLeaf) {
-      _objects.push_back(const_cast<Object *>(&obj));
-      if (_pivot) {
-        _pivotDist.push_back(_pivot->distance(obj));
-        size_t dist = _pivot->distance(obj);
-        if (dist > _radius) {
-          _radius = dist;
-        }
+      for (size_t i = 0; i < _count; ++i) {
+        LeafEntry &e = leafEntries()[i];
+        e.pivotDist = Metric()(_pivotKey, e.key);
+      }
+    } else {
+      for (size_t i = 0; i < _count; ++i) {
+        RoutingEntry &e = routingEntries()[i];
+        e.pivotDist = Metric()(_pivotKey, e.key);
+        e.child->_parentDistance = e.pivotDist;
       }
-      return _objects.size() > maxEntries;
     }
+  }
 
-    size_t minDist = SIZE_MAX;
-    MNode *sel = nullptr;
+  // Con cow el hijo elegido se copia antes de bajar: solo se modifican nodos
+  // que ningun lector puede ver todavia.
+  bool insert(Key *obj, view_type key, size_t maxEntries, SplitContext &ctx,
+              MCopyOnWrite<BasicMNode> *cow = nullptr) {
+    if (_isLeaf) {
+      appendObject(obj, key, Metric()(_pivotKey, key));
+      return _count > maxEntries;
+    }
 
-    size_t i = 0;
-    while (i < _children.size()) {
-      size_t d = _children[i]->_pivot->distance(obj);
+    // Solo interesa saber si mejora al mejor hijo visto: basta una cota
+    distance_type minDist = Dist::infinity();
+    size_t sel = 0;
+    for (size_t i = 0; i < _count && minDist > 0; ++i) {
+      distance_type d = Metric().atMost(routingEntries()[i].key, key,
+                                        Dist::below(minDist));
       if (d < minDist) {
         minDist = d;
-        sel = _children[i];
+        sel = i;
       }
-      i++;
     }
 
-    bool needsSplit = sel->insert(obj, maxEntries);
+    BasicMNode *child = routingEntries()[sel].child;
+    if (cow) {
+      cow->replaced.push_back(child);
+      child = child->copy();
+      routingEntries()[sel].child = child;
+    }
+    bool needsSplit = child->insert(obj, key, maxEntries, ctx, cow);
 
     if (needsSplit) {
-      if (!sel->_isLeaf) {
-        return _children.size() > maxEntries;
-      }
+      splitChild(sel, ctx);
+      return _count > maxEntries;
+    }
 
-      std::vector<Object *> allObjs = sel->_objects;
+    routingEntries()[sel].radius = child->_radius;
+    updateRadius();
+    return false;
+  }
 
-      if (allObjs.size() < 2) {
-        return false;
+  // Divide el hijo idx (hoja o interno) en dos segun la politica de ctx;
+  // el nodo nuevo se agrega al final.
+  void splitChild(size_t idx, SplitContext &ctx) {
+    BasicMNode *sel = routingEntries()[idx].child;
+    if (sel->_count < 2)
+      return;
+
+    const size_t n = sel->_count;
+    std::vector<LeafEntry> objs;
+    std::vector<RoutingEntry> kids;
+    std::vector<view_type> keys(n);
+    std::vector<distance_type> extents, cached(n);
+    if (sel->_isLeaf) {
+      objs.assign(sel->leafEntries(), sel->leafEntries() + n);
+      for (size_t i = 0; i < n; ++i) {
+        keys[i] = objs[i].key;
+        cached[i] = objs[i].pivotDist;
+      }
+    } else {
+      kids.assign(sel->routingEntries(), sel->routingEntries() + n);
+      for (size_t i = 0; i < n; ++i) {
+        keys[i] = kids[i].key;
+        cached[i] = kids[i].pivotDist;
+        extents.push_back(kids[i].radius);
       }
+    }
 
-      sel->_objects.clear();
-      sel->_pivotDist.clear();
+    // El pivot actual comparte memoria con su entrada (si sigue ahi)
+    size_t oldPivot = n;
+    for (size_t i = 0; i < n && oldPivot == n; ++i)
+      if (sameKey(keys[i], sel->_pivotKey))
+        oldPivot = i;
 
-      Object *pivot1 = allObjs[0];
-      Object *pivot2 = allObjs[1];
-      size_t maxDist = 0;
+    SplitPlan plan = planSplit(keys, extents, cached, oldPivot, ctx);
+    ctx.stats.splits++;
 
-      size_t x = 0;
-      while (x < allObjs.size()) {
-        size_t y = x + 1;
-        while (y < allObjs.size()) {
-          size_t dist = allObjs[x]->distance(*allObjs[y]);
-          if (dist > maxDist) {
-            maxDist = dist;
-            pivot1 = allObjs[x];
-            pivot2 = allObjs[y];
-          }
-          y++;
-        }
-        x++;
-      }
+    auto pivotOf = [&](size_t i) {
+      return sel->_isLeaf ? objs[i].object : kids[i].child->_pivot;
+    };
+    BasicMNode *newNode =
+        create(*_arena, _capacity, sel->_isLeaf, this, pivotOf(plan.second),
+               keys[plan.second], _table);
+    sel->setPivot(pivotOf(plan.first), keys[plan.first]);
+    sel->_count = 0;
+    sel->_radius = 0;
 
-      sel->_pivot = pivot1;
-      sel->_radius = 0;
+    for (size_t i = 0; i < n; ++i) {
+      BasicMNode *target = plan.toSecond[i] ? newNode : sel;
+      distance_type dist = plan.toSecond[i] ? plan.d2[i] : plan.d1[i];
+      // Las celdas de sel se leen antes de pisarse: target escribe la fila
+      // sel->_count <= i
+      if (sel->_isLeaf)
+        target->appendObject(objs[i].object, keys[i], dist, *sel, i);
+      else
+        target->appendChild(kids[i].child, dist);
+    }
 
-      MNode *newNode = new MNode(this, true, pivot2,
-                                 _pivot ? _pivot->distance(*pivot2) : 0, 0);
+    RoutingEntry &entry = routingEntries()[idx];
+    entry.key = sel->_pivotKey;
+    entry.pivotDist = Metric()(_pivotKey, sel->_pivotKey);
+    entry.radius = sel->_radius;
+    sel->_parentDistance = entry.pivotDist;
+    appendChild(newNode, Metric()(_pivotKey, newNode->_pivotKey));
+    updateRadius();
+  }
 
-      size_t objIdx = 0;
-      while (objIdx < allObjs.size()) {
-        Object *currentObj = allObjs[objIdx];
-        size_t dist1 = pivot1->distance(*currentObj);
-        size_t dist2 = pivot2->distance(*currentObj);
+  void rangeSearch(const Key &query, distance_type searchRadius,
+                   std::vector<Key *> &result,
+                   MQueryStats *stats = nullptr) const {
+    MQueryStats localStats;
+    MQueryStats &st = stats ? *stats : localStats;
 
-        if (dist1 <= dist2) {
-          sel->_objects.push_back(currentObj);
-          sel->_pivotDist.push_back(dist1);
-          if (dist1 > sel->_radius)
-            sel->_radius = dist1;
-        } else {
-          newNode->_objects.push_back(currentObj);
-          newNode->_pivotDist.push_back(dist2);
-          if (dist2 > newNode->_radius)
-            newNode->_radius = dist2;
-        }
-        objIdx++;
-      }
+    const view_type q = Metric::view(query);
+    distance_type pivotDist =
+        Metric().atMost(_pivotKey, q, searchRadius + _radius);
+    st.distanceComputations++;
 
-      _children.push_back(newNode);
-      updatePivotDistances();
-      updateRadius();
+    if (pivotDist > searchRadius + _radius)
+      return;
 
-      return _children.size() > maxEntries;
-    } else {
-      updateRadius();
+    // Las distancias de la consulta a los pivots globales se miden una vez
+    typename PivotTable::Query pq;
+    if (_table && _table->ready()) {
+      pq = _table->measure(q);
+      st.distanceComputations += _table->count();
     }
+    rangeSearchFrom(q, searchRadius, pivotDist, result, st,
+                    _table && _table->ready() ? &pq : nullptr);
+  }
 
-    return false;
+private:
+  using Dist = MDistance<distance_type>;
+
+  SlotArena *_arena;
+  BasicMNode *_parent;
+  Key *_pivot;
+  view_type _pivotKey;
+  std::uint32_t _count;
+  std::uint32_t _capacity;
+  bool _isLeaf;
+  distance_type _parentDistance;
+  distance_type _radius;
+  const PivotTable *_table;
+  // Las entradas siguen a la cabecera dentro del mismo slot, y en las hojas
+  // la tabla de pivots sigue a las entradas
+
+  static constexpr std::size_t kEntryBytes =
+      std::max(sizeof(LeafEntry), sizeof(RoutingEntry));
+
+  BasicMNode(SlotArena &arena, std::size_t capacity, bool leaf,
+             BasicMNode *parent, Key *pivot, view_type pivotKey,
+             const PivotTable *table)
+      : _arena(&arena), _parent(parent), _pivot(pivot), _pivotKey(pivotKey),
+        _count(0), _capacity(static_cast<std::uint32_t>(capacity)),
+        _isLeaf(leaf), _parentDistance(0), _radius(0), _table(table) {}
+
+  // La misma clave guardada (misma memoria), no solo una clave igual
+  static bool sameKey(view_type a, view_type b) noexcept {
+    if constexpr (std::is_pointer<view_type>::value)
+      return a == b;
+    else
+      return a.data() == b.data() && a.size() == b.size();
   }
 
-  void rangeSearch(const Object &query, std::size_t searchRadius,
-                   std::vector<Object *> &result) const {
-    if (!_pivot)
-      return;
+  LeafEntry *leafEntries() noexcept {
+    return reinterpret_cast<LeafEntry *>(this + 1);
+  }
+  RoutingEntry *routingEntries() noexcept {
+    return reinterpret_cast<RoutingEntry *>(this + 1);
+  }
 
-    size_t pivotDist = _pivot->distance(query);
+  unsigned char *pivotCells() noexcept {
+    return reinterpret_cast<unsigned char *>(this + 1) +
+           _capacity * kEntryBytes;
+  }
+  bool hasPivotCells() const noexcept {
+    return _isLeaf && _table && _table->ready();
+  }
 
-    if (pivotDist > searchRadius + _radius)
+  void pushObject(Key *obj, view_type key, distance_type pivotDist) {
+    reserveSlot();
+    new (leafEntries() + _count) LeafEntry{key, pivotDist, obj};
+    _count++;
+    if (pivotDist > _radius)
+      _radius = pivotDist;
+  }
+
+  void reserveSlot() const {
+    if (_count == _capacity)
+      throw std::length_error("MNode: capacidad del slot excedida");
+  }
+
+  struct SplitPlan {
+    size_t first = 0;  // entrada promovida para el nodo que se conserva
+    size_t second = 1; // entrada promovida para el nodo nuevo
+    std::vector<char> toSecond;
+    std::vector<distance_type> d1, d2; // distancia de cada entrada a cada pivot
+  };
+
+  // Promueve dos entradas de keys y reparte el resto. extents son los radios
+  // de los hijos (vacio en hojas), cached las distancias de cada entrada al
+  // pivot actual y oldPivot el indice de ese pivot (keys.size() si no esta).
+  static SplitPlan planSplit(const std::vector<view_type> &keys,
+                             const std::vector<distance_type> &extents,
+                             const std::vector<distance_type> &cached,
+                             size_t oldPivot, SplitContext &ctx) {
+    const size_t n = keys.size();
+    const SplitPolicy &policy = ctx.policy;
+    auto dist = [&](size_t a, size_t b) {
+      ctx.stats.distanceComputations++;
+      return Metric()(keys[a], keys[b]);
+    };
+    auto measure = [&](SplitPlan &plan) {
+      plan.d1.assign(n, 0);
+      plan.d2.assign(n, 0);
+      for (size_t i = 0; i < n; ++i) {
+        if (i != plan.first)
+          plan.d1[i] = dist(plan.first, i);
+        if (i != plan.second)
+          plan.d2[i] = dist(plan.second, i);
+      }
+    };
+
+    SplitPlan plan;
+    switch (policy.promote) {
+    case PromotePolicy::MaxDistance: {
+      std::vector<distance_type> all(n * n, 0);
+      distance_type maxDist = 0;
+      for (size_t x = 0; x < n; ++x) {
+        for (size_t y = x + 1; y < n; ++y) {
+          all[x * n + y] = all[y * n + x] = dist(x, y);
+          if (all[x * n + y] > maxDist) {
+            maxDist = all[x * n + y];
+            plan.first = x;
+            plan.second = y;
+          }
+        }
+      }
+      plan.d1.assign(all.begin() + plan.first * n,
+                     all.begin() + (plan.first + 1) * n);
+      plan.d2.assign(all.begin() + plan.second * n,
+                     all.begin() + (plan.second + 1) * n);
+      partition(plan, policy.partition);
+      return plan;
+    }
+    case PromotePolicy::Random: {
+      std::uniform_int_distribution<size_t> pick(0, n - 1);
+      plan.first = pick(ctx.rng);
+      do {
+        plan.second = pick(ctx.rng);
+      } while (plan.second == plan.first);
+      measure(plan);
+      partition(plan, policy.partition);
+      return plan;
+    }
+    case PromotePolicy::SampledMMRad: {
+      std::uniform_int_distribution<size_t> pick(0, n - 1);
+      distance_type bestRadius = Dist::infinity();
+      SplitPlan best;
+      for (size_t s = 0; s < std::max<size_t>(1, policy.samples); ++s) {
+        SplitPlan cand;
+        cand.first = pick(ctx.rng);
+        do {
+          cand.second = pick(ctx.rng);
+        } while (cand.second == cand.first);
+        measure(cand);
+        partition(cand, policy.partition);
+        distance_type r1 = 0, r2 = 0;
+        for (size_t i = 0; i < n; ++i) {
+          distance_type extent = i < extents.size() ? extents[i] : 0;
+          if (cand.toSecond[i])
+            r2 = std::max(r2, cand.d2[i] + extent);
+          else
+            r1 = std::max(r1, cand.d1[i] + extent);
+        }
+        if (std::max(r1, r2) < bestRadius) {
+          bestRadius = std::max(r1, r2);
+          best = std::move(cand);
+        }
+      }
+      return best;
+    }
+    case PromotePolicy::MLBDist: {
+      bool haveCache = cached.size() == n && oldPivot < n;
+      size_t p1 = oldPivot;
+      if (!haveCache) {
+        p1 = 0;
+        for (size_t i = 1; i < cached.size(); ++i)
+          if (cached[i] < cached[p1])
+            p1 = i;
+      }
+      plan.first = p1;
+      if (haveCache) {
+        plan.d1 = cached;
+      } else {
+        plan.d1.assign(n, 0);
+        for (size_t i = 0; i < n; ++i)
+          if (i != p1)
+            plan.d1[i] = dist(p1, i);
+      }
+      plan.second = p1 == 0 ? 1 : 0;
+      for (size_t i = 0; i < n; ++i)
+        if (i != p1 && plan.d1[i] > plan.d1[plan.second])
+          plan.second = i;
+      plan.d2.assign(n, 0);
+      for (size_t i = 0; i < n; ++i)
+        if (i != plan.second)
+          plan.d2[i] = dist(plan.second, i);
+      partition(plan, policy.partition);
+      return plan;
+    }
+    }
+    return plan;
+  }
+
+  static void partition(SplitPlan &plan, PartitionPolicy policy) {
+    const size_t n = plan.d1.size();
+    plan.toSecond.assign(n, 0);
+
+    if (policy == PartitionPolicy::Hyperplane) {
+      for (size_t i = 0; i < n; ++i)
+        plan.toSecond[i] = plan.d2[i] < plan.d1[i];
+      plan.toSecond[plan.first] = 0;
+      plan.toSecond[plan.second] = 1;
       return;
+    }
+
+    // Balanceado: cada pivot toma por turnos su entrada libre mas cercana
+    std::vector<size_t> order1(n), order2(n);
+    for (size_t i = 0; i < n; ++i)
+      order1[i] = order2[i] = i;
+    std::stable_sort(order1.begin(), order1.end(), [&](size_t a, size_t b) {
+      return plan.d1[a] < plan.d1[b];
+    });
+    std::stable_sort(order2.begin(), order2.end(), [&](size_t a, size_t b) {
+      return plan.d2[a] < plan.d2[b];
+    });
+
+    std::vector<char> taken(n, 0);
+    taken[plan.first] = taken[plan.second] = 1;
+    plan.toSecond[plan.second] = 1;
+    size_t left = n - 2;
+    size_t i1 = 0, i2 = 0;
+    bool turnFirst = true;
+    while (left > 0) {
+      std::vector<size_t> &order = turnFirst ? order1 : order2;
+      size_t &pos = turnFirst ? i1 : i2;
+      while (taken[order[pos]])
+        pos++;
+      taken[order[pos]] = 1;
+      plan.toSecond[order[pos]] = turnFirst ? 0 : 1;
+      left--;
+      turnFirst = !turnFirst;
+    }
+  }
 
+  // pivotDist = d(q, _pivot) ya calculada por el padre (exacta). Antes de
+  // medir un hijo o una entrada se descarta con |d(q,p) - d(p,c)| > r + r_c.
+  // En las hojas, pq (si hay) agrega la cota de los pivots globales.
+  void rangeSearchFrom(view_type query, distance_type searchRadius,
+                       distance_type pivotDist, std::vector<Key *> &result,
+                       MQueryStats &st,
+                       const typename PivotTable::Query *pq) const {
+    st.nodesVisited++;
     if (_isLeaf) {
-      size_t i = 0;
-      while (i < _objects.size()) {
-        if (_objects[i]->distance(query) <= searchRadius) {
-          result.push_back(_objects[i]);
+      const LeafEntry *e = leafEntries();
+      std::uint16_t pivotLower[PivotTable::kBlock];
+      for (size_t i = 0; i < _count; ++i) {
+        if (pq && i % PivotTable::kBlock == 0)
+          _table->bounds(pivotCells(), i, *pq, pivotLower);
+        if (Dist::absDiff(pivotDist, e[i].pivotDist) > searchRadius ||
+            (pq && pivotLower[i % PivotTable::kBlock] > searchRadius)) {
+          st.distancesAvoided++;
+          continue;
         }
-        i++;
+        st.distanceComputations++;
+        if (Metric().atMost(e[i].key, query, searchRadius) <= searchRadius)
+          result.push_back(e[i].object);
       }
-    } else {
-      size_t childIdx = 0;
-      while (childIdx < _children.size()) {
-        size_t childPivotDist = _children[childIdx]->_pivot->distance(query);
-        if (childPivotDist <= searchRadius + _children[childIdx]->_radius) {
-          _children[childIdx]->rangeSearch(query, searchRadius, result);
-        }
-        childIdx++;
+      return;
+    }
+
+    const RoutingEntry *e = routingEntries();
+    for (size_t i = 0; i < _count; ++i) {
+      distance_type reach = searchRadius + e[i].radius;
+      if (Dist::absDiff(pivotDist, e[i].pivotDist) > reach) {
+        st.distancesAvoided++;
+        continue;
       }
+      st.distanceComputations++;
+      distance_type childPivotDist = Metric().atMost(e[i].key, query, reach);
+      if (childPivotDist <= reach)
+        e[i].child->rangeSearchFrom(query, searchRadius, childPivotDist, result,
+                                    st, pq);
     }
   }
+};
 
-private:
-  MNode *_parent;
-  bool _isLeaf;
-  Object *_pivot;
-  size_t _parentDistance;
-  size_t _radius;
-  std::vector<Object *> _objects;
-  std::vector<MNode *> _children;
-  std::vector<size_t> _pivotDist;
+// Resumen de la forma del arbol
+struct MTreeStats {
+  std::size_t height = 0;
+  std::size_t nodes = 0;
+  std::size_t leaves = 0;
+  std::size_t entries = 0;
+  bool balanced = true; // todas las hojas a la misma profundidad
+  std::map<std::size_t, std::size_t> fanout;   // hijos -> nodos internos
+  std::map<std::size_t, std::size_t> leafFill; // objetos -> hojas
+  // Pares de hermanos cuyas bolas de cobertura se intersectan
+  std::size_t siblingPairs = 0;
+  std::size_t overlappingPairs = 0;
+  std::vector<double> meanRadiusByLevel;
+  std::size_t nodeBytes = 0; // arena de nodos
+  std::size_t keyBytes = 0;  // pool de claves
+  std::size_t indexBytes = 0; // indice hash (0 si esta apagado)
+
+  double overlapRatio() const {
+    return siblingPairs ? double(overlappingPairs) / double(siblingPairs) : 0;
+  }
+
+  void print(std::ostream &os) const {
+    os << "height=" << height << " nodes=" << nodes << " leaves=" << leaves
+       << " entries=" << entries << " balanced=" << (balanced ? "yes" : "no")
+       << '\n';
+    os << "fan-out:";
+    for (const auto &f : fanout)
+      os << ' ' << f.first << 'x' << f.second;
+    os << "\nleaf fill:";
+    for (const auto &f : leafFill)
+      os << ' ' << f.first << 'x' << f.second;
+    os << "\noverlap: " << overlappingPairs << '/' << siblingPairs << " ("
+       << 100.0 * overlapRatio() << "%)\n";
+    os << "mean radius by level:";
+    for (double r : meanRadiusByLevel)
+      os << ' ' << r;
+    os << "\nstorage: " << nodeBytes << " B nodos + " << keyBytes
+       << " B claves + " << indexBytes << " B indice\n";
+  }
 };
 
-class MTree {
+// M-tree generico sobre objetos Key con la distancia Metric. Las claves que
+// usan las entradas se guardan con Metric::store (copia al StringPool en las
+// metricas de cadenas, puntero al objeto en las demas).
+template <class Key, class Metric> class BasicMTree {
+public:
+  using Node = BasicMNode<Key, Metric>;
+  using view_type = typename Metric::view_type;
+  using distance_type = typename Metric::distance_type;
+  using store_type = typename Metric::store_type;
+  using LeafEntry = typename Node::LeafEntry;
+  using RoutingEntry = typename Node::RoutingEntry;
+
 private:
-  MNode *_root;
+  using Dist = MDistance<distance_type>;
+
+  // Atomico para que ConcurrentBasicMTree publique raices nuevas; cada consulta
+  // lee la raiz una sola vez
+  std::atomic<Node *> _root;
   size_t _maxEntries;
+  SplitContext _split;
+  // Pivots globales de las hojas; antes de _nodes porque fija el slot
+  MPivotTable<Metric> _pivots;
+  // Slots de maxEntries + 1 entradas: un nodo desbordado cabe hasta dividirse
+  SlotArena _nodes;
+  // Copia contigua de las claves; las entradas apuntan aqui
+  store_type _keys;
+  // Objetos que pertenecen al arbol (bulkLoad); deque mantiene las direcciones
+  std::deque<Key> _owned;
+  // Indice exacto opcional (setHashIndex); un objeto por entrada de hoja
+  MHashIndex<Key, Metric> _index;
+  bool _indexed = false;
 
 public:
-  explicit MTree(size_t maxEntries = 10)
-      : _root(nullptr), _maxEntries(maxEntries) {}
+  // pivots.count > 0 agrega a cada hoja las distancias de sus entradas a P
+  // pivots globales (solo metricas enteras). Los elige bulkLoad o, sin
+  // carga masiva, son las primeras P claves distintas insertadas.
+  explicit BasicMTree(size_t maxEntries = 10,
+                      SplitPolicy policy = SplitPolicy(),
+                      MPivotOptions pivots = MPivotOptions())
+      : _root(nullptr), _maxEntries(maxEntries),
+        _pivots(pivots, maxEntries + 1),
+        _nodes(Node::slotSize(maxEntries + 1, _pivots.bytes())) {
+    _split.policy = policy;
+  }
 
-  ~MTree() { delete _root; }
+  BasicMTree(const BasicMTree &) = delete;
+  BasicMTree &operator=(const BasicMTree &) = delete;
 
-  MNode *root() const noexcept { return _root; }
+  Node *root() const noexcept { return _root.load(); }
   size_t maxEntries() const noexcept { return _maxEntries; }
+  const MPivotTable<Metric> &pivotTable() const noexcept { return _pivots; }
+  const SplitPolicy &splitPolicy() const noexcept { return _split.policy; }
+  const MSplitStats &splitStats() const noexcept { return _split.stats; }
+  // Memoria reservada por la arena de nodos, el pool de claves y el indice
+  size_t storageBytes() const noexcept {
+    return _nodes.bytesReserved() + _keys.bytesReserved() +
+           _index.bytesReserved();
+  }
 
-  void insert(const Object &obj) {
-    if (!_root) {
-      _root = new MNode(true);
-      _root->setPivot(const_cast<Object *>(&obj));
+  // Indice hash opcional de coincidencia exacta: search e insertUnique pasan
+  // a ser O(1) sin calcular distancias y erase descarta en O(1) las claves
+  // que no estan, a cambio de 16 B por ranura (la tabla queda entre 1/4 y 1/2
+  // llena, ver MTreeStats::indexBytes). Solo para MTree; ConcurrentMTree no
+  // lo activa porque sus lectores no toman locks.
+  void setHashIndex(bool enabled) {
+    _index.clear();
+    _indexed = enabled;
+    if (!enabled)
+      return;
+    std::vector<Key *> objs;
+    std::vector<view_type> keys;
+    if (const Node *root = _root.load())
+      collectEntries(root, objs, keys);
+    for (Key *obj : objs)
+      _index.insert(obj);
+  }
+  bool hashIndex() const noexcept { return _indexed; }
+
+  void insert(const Key &obj) { insert(obj, nullptr); }
+
+  // Inserta solo si no hay ya un objeto a distancia 0; con el indice hash la
+  // comprobacion es O(1)
+  bool insertUnique(const Key &obj) {
+    if (search(obj))
+      return false;
+    insert(obj, nullptr);
+    return true;
+  }
+
+  // Un nodo con menos entradas se une a su hermano mas cercano o le pide
+  // entradas (solo tras erase; los splits pueden dejar nodos mas chicos)
+  size_t minEntries() const noexcept {
+    return std::max<size_t>(1, _maxEntries / 4);
+  }
+
+  // Quita obj: la entrada con esa misma direccion si esta en el arbol, si no
+  // alguna a distancia 0. Los radios se ajustan solo si la entrada quitada
+  // los definia y sin calcular distancias (con las guardadas en los nodos).
+  // Con metricas que guardan punteros (PointerStore) obj puede seguir siendo
+  // pivot de ruteo: debe vivir mientras viva el arbol, como al insertarlo.
+  bool erase(const Key &obj) {
+    EraseState st;
+    if (!eraseEntry(obj, &obj, st))
+      return false;
+    finishErase(st);
+    return true;
+  }
+
+  // Borrado en lote: primero se quitan todas las entradas y despues se
+  // resuelven los underflow y los radios una sola vez por nodo, en lugar de
+  // reorganizar el arbol tras cada objeto. objs son copias, asi que se quita
+  // la primera entrada a distancia 0 de cada una. Devuelve cuantas se
+  // quitaron.
+  size_t erase(const std::vector<Key> &objs) {
+    EraseState st;
+    size_t erased = 0;
+    for (const Key &obj : objs)
+      erased += eraseEntry(obj, nullptr, st);
+    finishErase(st);
+    return erased;
+  }
+
+  // Reemplaza oldObj por newObj (erase + insert); false si oldObj no estaba
+  bool update(const Key &oldObj, const Key &newObj) {
+    if (!erase(oldObj))
+      return false;
+    insert(newObj);
+    return true;
+  }
+
+  // Recorre el arbol completo; el solapamiento calcula d(p_i, p_j) entre
+  // hermanos, asi que cuesta O(M^2) distancias por nodo interno.
+  MTreeStats statistics() const {
+    MTreeStats st;
+    const Node *root = _root.load();
+    if (!root)
+      return st;
+
+    std::vector<double> radiusSum;
+    std::vector<std::size_t> levelNodes;
+    std::size_t leafDepth = 0;
+    std::function<void(const Node *, std::size_t)> walk =
+        [&](const Node *node, std::size_t depth) {
+          st.nodes++;
+          st.height = std::max(st.height, depth + 1);
+          if (radiusSum.size() <= depth) {
+            radiusSum.resize(depth + 1, 0);
+            levelNodes.resize(depth + 1, 0);
+          }
+          radiusSum[depth] += node->radius();
+          levelNodes[depth]++;
+          if (node->isLeaf()) {
+            st.leaves++;
+            st.entries += node->objects().size();
+            st.leafFill[node->objects().size()]++;
+            if (st.leaves == 1)
+              leafDepth = depth;
+            else if (depth != leafDepth)
+              st.balanced = false;
+            return;
+          }
+          const RoutingEntry *kids = node->routingEntries();
+          st.fanout[node->size()]++;
+          for (std::size_t i = 0; i < node->size(); ++i) {
+            for (std::size_t j = i + 1; j < node->size(); ++j) {
+              st.siblingPairs++;
+              distance_type reach = kids[i].radius + kids[j].radius;
+              if (Metric().atMost(kids[i].key, kids[j].key, reach) <= reach)
+                st.overlappingPairs++;
+            }
+            walk(kids[i].child, depth + 1);
+          }
+        };
+    walk(root, 0);
 
-      std::vector<Object *> initialObjs;
-      initialObjs.push_back(const_cast<Object *>(&obj));
-      _root->setObjects(initialObjs);
+    st.nodeBytes = _nodes.bytesReserved();
+    st.keyBytes = _keys.bytesReserved();
+    st.indexBytes = _index.bytesReserved();
+    for (std::size_t l = 0; l < levelNodes.size(); ++l)
+      st.meanRadiusByLevel.push_back(double(radiusSum[l]) / levelNodes[l]);
+    return st;
+  }
 
-      std::vector<size_t> initialDists;
-      initialDists.push_back(0);
-      _root->setPivotDistances(initialDists);
+  // Carga masiva de abajo hacia arriba: las hojas salen de agrupar los
+  // objetos por muestreo y cada nivel superior agrupa los pivots del nivel
+  // anterior, asi todas las hojas quedan a la misma profundidad. Los objetos
+  // pasan a ser del arbol; si ya habia datos se reconstruye con todos.
+  void bulkLoad(std::vector<Key> objects, size_t threads = 0) {
+    if (threads == 0)
+      threads = std::max<size_t>(1, std::thread::hardware_concurrency());
 
-      _root->setRadius(0);
+    std::vector<Key *> objs;
+    std::vector<view_type> keys;
+    if (Node *old = _root.exchange(nullptr)) {
+      collectEntries(old, objs, keys);
+      _nodes.clear();
+    }
+    size_t i = 0;
+    while (i < objects.size()) {
+      _owned.push_back(std::move(objects[i]));
+      objs.push_back(&_owned.back());
+      keys.push_back(Metric::view(_owned.back()));
+      i++;
+    }
+    if (objs.empty())
       return;
+    if (_indexed) {
+      _index.clear();
+      for (Key *obj : objs)
+        _index.insert(obj);
     }
 
-    bool rootOverflow = _root->insert(obj, _maxEntries);
+    std::mt19937 gen(12345);
 
-    if (rootOverflow) {
-      MNode *oldRoot = _root;
-      _root = new MNode(false);
+    std::vector<BulkGroup> groups;
+    std::vector<size_t> members(keys.size());
+    for (size_t m = 0; m < members.size(); ++m)
+      members[m] = m;
+    bulkPartition(keys, std::move(members), 0, groups, gen, threads);
 
-      std::vector<MNode *> newChildren;
-      newChildren.push_back(oldRoot);
-      _root->setChildren(newChildren);
+    // Las claves pasan a un pool nuevo en orden de hoja, asi cada hoja lee
+    // sus claves de bytes contiguos. La arena no es concurrente: los nodos
+    // se crean aqui y se llenan en paralelo.
+    store_type pool;
+    if (_pivots.count())
+      _pivots.setKeys(choosePivots(objs, keys, pool, gen));
+    std::vector<Node *> level(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) {
+      for (size_t idx : groups[g].members)
+        keys[idx] = Metric::store(*objs[idx], pool);
+      size_t c = groups[g].center;
+      level[g] = Node::create(_nodes, _maxEntries + 1, true, nullptr, objs[c],
+                              keys[c], &_pivots);
+    }
+    parallelFor(groups.size(), threads, [&](size_t g) {
+      Node *leaf = level[g];
+      for (size_t idx : groups[g].members)
+        leaf->appendObject(objs[idx], keys[idx],
+                           Metric()(leaf->pivotKey(), keys[idx]));
+    });
+
+    while (level.size() > 1) {
+      std::vector<view_type> pivots(level.size());
+      for (size_t n = 0; n < level.size(); ++n)
+        pivots[n] = level[n]->pivotKey();
 
-      oldRoot->setParent(_root);
-      oldRoot->setParentDistance(0);
-      _root->setPivot(oldRoot->pivot());
+      groups.clear();
+      std::vector<size_t> nodeIdx(level.size());
+      for (size_t n = 0; n < nodeIdx.size(); ++n)
+        nodeIdx[n] = n;
+      bulkPartition(pivots, std::move(nodeIdx), 0, groups, gen, threads);
 
-      std::vector<size_t> rootDists;
-      rootDists.push_back(0);
-      _root->setPivotDistances(rootDists);
-      _root->setRadius(oldRoot->radius());
+      std::vector<Node *> next(groups.size());
+      for (size_t g = 0; g < groups.size(); ++g) {
+        const Node *c = level[groups[g].center];
+        next[g] = Node::create(_nodes, _maxEntries + 1, false, nullptr,
+                               c->pivot(), c->pivotKey(), &_pivots);
+      }
+      parallelFor(groups.size(), threads, [&](size_t g) {
+        Node *node = next[g];
+        for (size_t idx : groups[g].members)
+          node->appendChild(level[idx],
+                            Metric()(node->pivotKey(), pivots[idx]));
+      });
+      level.swap(next);
     }
+
+    level[0]->setParent(nullptr);
+    level[0]->setParentDistance(0);
+    _keys = std::move(pool);
+    _root.store(level[0]);
   }
 
-  bool search(const Object &obj) const {
-    if (!_root)
+  // Algun objeto a distancia 0 de obj
+  bool search(const Key &obj, MQueryStats *stats = nullptr) const {
+    if (_indexed)
+      return _index.find(Metric::view(obj)) != nullptr;
+    const Node *root = _root.load();
+    if (!root)
       return false;
 
-    std::vector<Object *> searchResults;
-    _root->rangeSearch(obj, 0, searchResults);
-
-    size_t i = 0;
-    while (i < searchResults.size()) {
-      if (searchResults[i]->str() == obj.str())
-        return true;
-      i++;
-    }
-    return false;
+    std::vector<Key *> searchResults;
+    root->rangeSearch(obj, 0, searchResults, stats);
+    return !searchResults.empty();
   }
 
-  std::vector<Object *> rangeSearch(const Object &query,
-                                    size_t searchRadius) const {
-    std::vector<Object *> results;
-    if (_root) {
-      _root->rangeSearch(query, searchRadius, results);
+  std::vector<Key *> rangeSearch(const Key &query, distance_type searchRadius,
+                                 MQueryStats *stats = nullptr) const {
+    std::vector<Key *> results;
+    if (const Node *root = _root.load()) {
+      root->rangeSearch(query, searchRadius, results, stats);
     }
     return results;
   }
 
-  std::vector<Object *> kNearestNeighbors(const Object &query, size_t k) const {
-    if (!_root || k == 0)
+  // k-NN best-first: los nodos se expanden en orden de distancia minima y se
+  // podan con la cota dinamica del k-esimo mejor candidato.
+  std::vector<Key *> kNearestNeighbors(const Key &query, size_t k,
+                                       MQueryStats *stats = nullptr) const {
+    const Node *root = _root.load();
+    if (!root || k == 0)
       return {};
 
-    std::vector<Object *> allObjs;
-    std::function<void(MNode *)> collectAllObjects = [&](MNode *node) {
-      if (!node)
-        return;
+    MQueryStats localStats;
+    MQueryStats &st = stats ? *stats : localStats;
+
+    struct Pending {
+      distance_type minDist;
+      distance_type pivotDist;
+      const Node *node;
+      bool operator>(const Pending &other) const {
+        return minDist > other.minDist;
+      }
+    };
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>>
+        pending;
+    std::priority_queue<std::pair<distance_type, Key *>> best;
+
+    auto bound = [&]() -> distance_type {
+      return best.size() < k ? Dist::infinity() : best.top().first;
+    };
+
+    const view_type q = Metric::view(query);
+    distance_type rootDist = Metric()(root->pivotKey(), q);
+    st.distanceComputations++;
+    const bool usePivots = _pivots.ready();
+    typename MPivotTable<Metric>::Query pq;
+    if (usePivots) {
+      pq = _pivots.measure(q);
+      st.distanceComputations += _pivots.count();
+    }
+    std::uint16_t pivotLower[MPivotTable<Metric>::kBlock];
+    distance_type rootMin = Dist::minus(rootDist, root->radius());
+    pending.push({rootMin, rootDist, root});
+
+    while (!pending.empty()) {
+      Pending cur = pending.top();
+      pending.pop();
+
+      if (cur.minDist >= bound())
+        break;
+
+      const Node *node = cur.node;
+      st.nodesVisited++;
 
       if (node->isLeaf()) {
-        size_t i = 0;
-        while (i < node->objects().size()) {
-          allObjs.push_back(node->objects()[i]);
-          i++;
+        const LeafEntry *e = node->leafEntries();
+        for (size_t i = 0; i < node->size(); ++i) {
+          const size_t j = i % MPivotTable<Metric>::kBlock;
+          if (usePivots && j == 0)
+            _pivots.bounds(node->pivotCells(), i, pq, pivotLower);
+          // d(q, o) >= |d(q, p) - d(p, o)|, y lo mismo con los pivots globales
+          if (Dist::absDiff(cur.pivotDist, e[i].pivotDist) >= bound() ||
+              (usePivots && pivotLower[j] >= bound())) {
+            st.distancesAvoided++;
+            continue;
+          }
+          distance_type dist =
+              best.size() < k
+                  ? Metric()(e[i].key, q)
+                  : Metric().atMost(e[i].key, q, Dist::below(bound()));
+          st.distanceComputations++;
+          if (best.size() < k) {
+            best.push({dist, e[i].object});
+          } else if (dist < best.top().first) {
+            best.pop();
+            best.push({dist, e[i].object});
+          }
         }
       } else {
-        size_t i = 0;
-        while (i < node->children().size()) {
-          collectAllObjects(node->children()[i]);
-          i++;
+        const RoutingEntry *e = node->routingEntries();
+        for (size_t i = 0; i < node->size(); ++i) {
+          distance_type lower = Dist::minus(
+              Dist::absDiff(cur.pivotDist, e[i].pivotDist), e[i].radius);
+          if (lower >= bound()) {
+            st.distancesAvoided++;
+            continue;
+          }
+          // Solo importa si d - r < cota; por encima basta una cota
+          distance_type dist =
+              best.size() < k
+                  ? Metric()(e[i].key, q)
+                  : Metric().atMost(e[i].key, q,
+                                    Dist::below(bound() + e[i].radius));
+          st.distanceComputations++;
+          distance_type minDist = Dist::minus(dist, e[i].radius);
+          if (minDist < bound())
+            pending.push({minDist, dist, e[i].child});
         }
       }
+    }
+
+    std::vector<Key *> kRes(best.size());
+    size_t idx = best.size();
+    while (!best.empty()) {
+      kRes[--idx] = best.top().second;
+      best.pop();
+    }
+
+    return kRes;
+  }
+
+  // Vecinos en orden de distancia no decreciente, sin fijar k. Un solo heap
+  // guarda nodos y objetos; cada entrada entra con su cota inferior (pivot
+  // del padre y pivots globales) y se mide recien al salir del heap, asi
+  // solo se calculan las distancias que los vecinos consumidos necesitan.
+  // El arbol no debe modificarse mientras se itera.
+  class NearestIterator {
+  public:
+    struct Neighbor {
+      Key *object;
+      distance_type distance;
     };
 
-    collectAllObjects(_root);
+    NearestIterator(const BasicMTree &tree, const Key &query)
+        : _tree(&tree), _query(query) {
+      const Node *root = tree._root.load();
+      if (!root)
+        return;
+      const view_type q = Metric::view(_query);
+      if (tree._pivots.ready()) {
+        _pivotQuery = tree._pivots.measure(q);
+        _stats.distanceComputations += tree._pivots.count();
+      }
+      distance_type d = Metric()(root->pivotKey(), q);
+      _stats.distanceComputations++;
+      _pending.push({Dist::minus(d, root->radius()), d, root, nullptr,
+                     root->pivotKey(), true});
+    }
+
+    // Siguiente vecino; vacio cuando se recorrio todo el arbol
+    std::optional<Neighbor> next() {
+      const view_type q = Metric::view(_query);
+      while (!_pending.empty()) {
+        Item cur = _pending.top();
+        _pending.pop();
+        if (!cur.exact) {
+          // Se mide y vuelve al heap con su valor exacto
+          cur.pivotDist = Metric()(cur.key, q);
+          _stats.distanceComputations++;
+          cur.bound = cur.node ? Dist::minus(cur.pivotDist, cur.node->radius())
+                               : cur.pivotDist;
+          cur.exact = true;
+          _pending.push(cur);
+        } else if (!cur.node) {
+          return Neighbor{cur.object, cur.pivotDist};
+        } else {
+          expand(cur.node, cur.pivotDist);
+        }
+      }
+      return std::nullopt;
+    }
+
+    const MQueryStats &stats() const noexcept { return _stats; }
 
-    std::vector<std::pair<size_t, Object *>> d;
-    size_t i = 0;
-    while (i < allObjs.size()) {
-      size_t dist = allObjs[i]->distance(query);
-      d.push_back({dist, allObjs[i]});
-      i++;
+  private:
+    // Nodo (node != nullptr) u objeto del heap. exact: pivotDist ya es
+    // d(q, pivot) o d(q, objeto); si no, bound es solo una cota inferior.
+    struct Item {
+      distance_type bound;
+      distance_type pivotDist;
+      const Node *node;
+      Key *object;
+      view_type key;
+      bool exact;
+      // A igual cota sale primero lo ya medido
+      bool operator>(const Item &other) const {
+        return bound != other.bound ? bound > other.bound
+                                    : exact < other.exact;
+      }
+    };
+
+    const BasicMTree *_tree;
+    Key _query;
+    typename MPivotTable<Metric>::Query _pivotQuery;
+    MQueryStats _stats;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>>
+        _pending;
+
+    void expand(const Node *node, distance_type pivotDist) {
+      _stats.nodesVisited++;
+      if (!node->isLeaf()) {
+        const RoutingEntry *e = node->routingEntries();
+        for (size_t i = 0; i < node->size(); ++i)
+          _pending.push({Dist::minus(Dist::absDiff(pivotDist, e[i].pivotDist),
+                                     e[i].radius),
+                         0, e[i].child, nullptr, e[i].key, false});
+        return;
+      }
+      const bool usePivots = _tree->_pivots.ready();
+      std::uint16_t pivotLower[MPivotTable<Metric>::kBlock];
+      const LeafEntry *e = node->leafEntries();
+      for (size_t i = 0; i < node->size(); ++i) {
+        const size_t j = i % MPivotTable<Metric>::kBlock;
+        if (usePivots && j == 0)
+          _tree->_pivots.bounds(node->pivotCells(), i, _pivotQuery,
+                                pivotLower);
+        distance_type bound = Dist::absDiff(pivotDist, e[i].pivotDist);
+        if (usePivots && pivotLower[j] > bound)
+          bound = pivotLower[j];
+        _pending.push({bound, 0, nullptr, e[i].object, e[i].key, false});
+      }
+    }
+  };
+
+  // El iterador copia la consulta; el arbol debe seguir vivo mientras se usa
+  NearestIterator nearestIterator(const Key &query) const {
+    return NearestIterator(*this, query);
+  }
+
+  // Lotes de consultas repartidos entre threads con robo de trabajo. Las
+  // consultas se ordenan por el subarbol mas cercano (dos niveles bajo la
+  // raiz) y se reparten en bloques consecutivos, asi cada thread recorre
+  // casi siempre los mismos nodos. results[i] corresponde a queries[i].
+  std::vector<std::vector<Key *>>
+  rangeSearchBatch(const std::vector<Key> &queries, distance_type searchRadius,
+                   size_t threads = 0, MQueryStats *stats = nullptr) const {
+    return runBatch(queries, threads, stats,
+                    [&](const Key &q, MQueryStats &st) {
+                      return rangeSearch(q, searchRadius, &st);
+                    });
+  }
+
+  std::vector<std::vector<Key *>>
+  kNearestNeighborsBatch(const std::vector<Key> &queries, size_t k,
+                         size_t threads = 0,
+                         MQueryStats *stats = nullptr) const {
+    return runBatch(queries, threads, stats,
+                    [&](const Key &q, MQueryStats &st) {
+                      return kNearestNeighbors(q, k, &st);
+                    });
+  }
+
+private:
+  friend class ::ConcurrentMTree;
+
+  // Consultas por tarea: bloques chicos para que el robo equilibre la carga
+  static constexpr size_t kBatchChunk = 16;
+
+  template <class Query>
+  std::vector<std::vector<Key *>>
+  runBatch(const std::vector<Key> &queries, size_t threads,
+           MQueryStats *stats, Query query) const {
+    if (threads == 0)
+      threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<std::vector<Key *>> results(queries.size());
+
+    std::vector<std::pair<size_t, size_t>> order(queries.size());
+    parallelFor(queries.size(), threads, [&](size_t i) {
+      order[i] = {subtreeKey(Metric::view(queries[i])), i};
+    });
+    std::sort(order.begin(), order.end());
+
+    std::vector<MQueryStats> perThread(threads);
+    const size_t tasks = (order.size() + kBatchChunk - 1) / kBatchChunk;
+    stealingFor(tasks, threads, [&](size_t task, size_t worker) {
+      size_t hi = std::min(order.size(), (task + 1) * kBatchChunk);
+      for (size_t j = task * kBatchChunk; j < hi; ++j) {
+        size_t i = order[j].second;
+        results[i] = query(queries[i], perThread[worker]);
+      }
+    });
+
+    if (stats) {
+      for (const MQueryStats &st : perThread)
+        *stats += st;
+    }
+    return results;
+  }
+
+  // Indices del hijo mas cercano en los dos primeros niveles; consultas con
+  // la misma clave bajan casi siempre por los mismos nodos
+  size_t subtreeKey(view_type q) const {
+    size_t key = 0;
+    const Node *node = _root.load();
+    for (int level = 0; level < 2 && node && !node->isLeaf(); ++level) {
+      const RoutingEntry *e = node->routingEntries();
+      size_t best = 0;
+      distance_type bestDist = Dist::infinity();
+      for (size_t i = 0; i < node->size() && bestDist > 0; ++i) {
+        distance_type d = Metric().atMost(e[i].key, q, Dist::below(bestDist));
+        if (d < bestDist) {
+          bestDist = d;
+          best = i;
+        }
+      }
+      key = key * (_maxEntries + 1) + best;
+      node = e[best].child;
     }
+    return key;
+  }
+
+  // Nodos pendientes de un erase: dirty necesita ajustar radios, underflow
+  // quedo con menos de minEntries. Un nodo liberado sale de ambos.
+  struct EraseState {
+    std::unordered_set<Node *> dirty, underflow;
 
-    std::sort(d.begin(), d.end());
+    void release(Node *node) {
+      dirty.erase(node);
+      underflow.erase(node);
+      Node::release(node);
+    }
+  };
 
-    std::vector<Object *> kRes;
+  // Quita la entrada de target (o, si no esta o es nullptr, una a distancia
+  // 0 de obj) sin reorganizar nada todavia
+  bool eraseEntry(const Key &obj, const Key *target, EraseState &st) {
+    Node *root = _root.load();
+    if (!root)
+      return false;
+    const view_type q = Metric::view(obj);
+    // Con el indice las claves ausentes se descartan sin recorrer el arbol,
+    // y si obj no es un objeto guardado basta la primera entrada a
+    // distancia 0
+    if (_indexed) {
+      if (!_index.find(q))
+        return false;
+      if (target && !_index.contains(target))
+        target = nullptr;
+    }
+    Node *leaf = nullptr;
     size_t idx = 0;
-    while (idx < k && idx < d.size()) {
-      kRes.push_back(d[idx].second);
-      idx++;
+    locate(root, q, target, Metric()(root->pivotKey(), q), leaf, idx);
+    if (!leaf)
+      return false;
+
+    // Si la entrada no definia el radio, otra lo alcanza y no cambia nada
+    const distance_type extent = leaf->pivotDistances()[idx];
+    if (_indexed)
+      _index.erase(leaf->objects()[idx]);
+    leaf->removeEntry(idx);
+    if (extent == leaf->radius())
+      st.dirty.insert(leaf);
+    if (leaf->size() < minEntries())
+      st.underflow.insert(leaf);
+    return true;
+  }
+
+  // Busca en las bolas que contienen a q: devuelve true (y corta) al hallar
+  // target; mientras tanto recuerda la primera entrada a distancia 0. Sin
+  // target corta en esa primera entrada.
+  static bool locate(Node *node, view_type q, const Key *target,
+                     distance_type pivotDist, Node *&leaf, size_t &idx) {
+    if (node->isLeaf()) {
+      const LeafEntry *e = std::as_const(*node).leafEntries();
+      for (size_t i = 0; i < node->size(); ++i) {
+        // d(q, o) = 0 exige d(p, o) = d(p, q)
+        if (e[i].pivotDist != pivotDist)
+          continue;
+        if (e[i].object == target || (!leaf && Metric()(e[i].key, q) == 0)) {
+          leaf = node;
+          idx = i;
+          if (!target || e[i].object == target)
+            return true;
+        }
+      }
+      return false;
+    }
+    const RoutingEntry *e = std::as_const(*node).routingEntries();
+    for (size_t i = 0; i < node->size(); ++i) {
+      if (Dist::absDiff(pivotDist, e[i].pivotDist) > e[i].radius)
+        continue;
+      distance_type d = Metric().atMost(e[i].key, q, e[i].radius);
+      if (d <= e[i].radius && locate(e[i].child, q, target, d, leaf, idx))
+        return true;
     }
+    return false;
+  }
 
-    return kRes;
+  void finishErase(EraseState &st) {
+    while (!st.underflow.empty()) {
+      Node *node = *st.underflow.begin();
+      st.underflow.erase(st.underflow.begin());
+      fixUnderflow(node, st);
+    }
+    shrinkRoot(st);
+    for (Node *node : st.dirty)
+      tightenRadius(node);
+  }
+
+  // Une node con su hermano mas cercano si caben en un nodo; si no, le
+  // pasa las entradas del hermano mas cercanas a su pivot. Un merge puede
+  // dejar al padre en underflow y se sigue hacia arriba. Las hojas no
+  // cambian de profundidad, asi que el arbol sigue balanceado.
+  void fixUnderflow(Node *node, EraseState &st) {
+    for (;;) {
+      Node *parent = node->parent();
+      if (!parent || node->size() >= minEntries())
+        return;
+      size_t idx = parent->childIndex(node);
+
+      // Un nodo vacio se quita y el padre hereda el problema
+      if (node->size() == 0) {
+        parent->removeEntry(idx);
+        st.release(node);
+        st.dirty.insert(parent);
+        node = parent;
+        continue;
+      }
+      // Hijo unico: el padre (con una sola entrada) se une a su propio
+      // hermano o lo resuelve shrinkRoot
+      size_t sib = nearestSibling(parent, idx);
+      if (sib == parent->size()) {
+        node = parent;
+        continue;
+      }
+
+      Node *sibling = parent->children()[sib];
+      if (sibling->size() + node->size() <= _maxEntries) {
+        std::vector<size_t> all(node->size());
+        for (size_t i = 0; i < all.size(); ++i)
+          all[i] = i;
+        moveEntries(node, sibling, all);
+        parent->removeEntry(idx);
+        st.release(node);
+        parent->syncChildRadius(parent->childIndex(sibling));
+        st.dirty.insert(parent);
+        node = parent;
+        continue;
+      }
+
+      // Redistribucion: el hermano queda con mas de minEntries porque
+      // entre ambos superan _maxEntries
+      const Node &from = *sibling;
+      std::vector<std::pair<distance_type, size_t>> byDist(from.size());
+      for (size_t i = 0; i < byDist.size(); ++i)
+        byDist[i] = {Metric()(node->pivotKey(),
+                              from.isLeaf() ? from.leafEntries()[i].key
+                                            : from.routingEntries()[i].key),
+                     i};
+      std::sort(byDist.begin(), byDist.end());
+      std::vector<size_t> taken;
+      for (size_t i = 0; node->size() + taken.size() < minEntries(); ++i)
+        taken.push_back(byDist[i].second);
+      moveEntries(sibling, node, taken);
+      parent->syncChildRadius(idx);
+      parent->syncChildRadius(sib);
+      st.dirty.insert(parent);
+      return;
+    }
+  }
+
+  // Hermano de la entrada idx con el pivot mas cercano (parent->size() si no
+  // tiene hermanos)
+  static size_t nearestSibling(const Node *parent, size_t idx) {
+    const RoutingEntry *e = parent->routingEntries();
+    size_t best = parent->size();
+    distance_type bestDist = Dist::infinity();
+    for (size_t i = 0; i < parent->size() && bestDist > 0; ++i) {
+      if (i == idx)
+        continue;
+      distance_type d =
+          Metric().atMost(e[idx].key, e[i].key, Dist::below(bestDist));
+      if (best == parent->size() || d < bestDist) {
+        bestDist = d;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // Pasa las entradas which de from a to, midiendo su distancia al pivot de
+  // to. El radio de to crece al agregar y el de from se recalcula.
+  static void moveEntries(Node *from, Node *to, std::vector<size_t> which) {
+    for (size_t i : which) {
+      if (from->isLeaf()) {
+        const LeafEntry &e = std::as_const(*from).leafEntries()[i];
+        to->appendObject(e.object, e.key, Metric()(to->pivotKey(), e.key),
+                         *from, i);
+      } else {
+        const RoutingEntry &e = std::as_const(*from).routingEntries()[i];
+        to->appendChild(e.child, Metric()(to->pivotKey(), e.key));
+      }
+    }
+    // De mayor a menor: removeEntry mueve la ultima entrada al hueco
+    std::sort(which.rbegin(), which.rend());
+    for (size_t i : which)
+      from->removeEntry(i);
+    from->updateRadius();
+  }
+
+  // Raiz interna con un solo hijo: el hijo pasa a ser la raiz; raiz vacia:
+  // el arbol queda vacio
+  void shrinkRoot(EraseState &st) {
+    Node *root = _root.load();
+    while (root && !root->isLeaf() && root->size() <= 1) {
+      Node *child = root->size() ? root->children()[0] : nullptr;
+      st.release(root);
+      root = child;
+      if (root) {
+        root->setParent(nullptr);
+        root->setParentDistance(0);
+      }
+    }
+    if (root && root->size() == 0) {
+      st.release(root);
+      root = nullptr;
+    }
+    _root.store(root);
+  }
+
+  // Recalcula el radio de node con las distancias guardadas y sube mientras
+  // el radio del padre cambie
+  static void tightenRadius(Node *node) {
+    node->updateRadius();
+    while (Node *parent = node->parent()) {
+      const distance_type before = parent->radius();
+      parent->syncChildRadius(parent->childIndex(node));
+      parent->updateRadius();
+      if (parent->radius() == before)
+        return;
+      node = parent;
+    }
+  }
+
+  // Con cow la raiz y el camino se modifican sobre copias y la raiz nueva se
+  // publica al final; sin cow se modifica en el lugar.
+  void insert(const Key &obj, MCopyOnWrite<Node> *cow) {
+    Key *o = const_cast<Key *>(&obj);
+    view_type key = Metric::store(obj, _keys);
+    if (_indexed)
+      _index.insert(o);
+    if (_pivots.count() && !_pivots.ready())
+      notePivot(key);
+    Node *root = _root.load();
+    if (!root) {
+      root = Node::create(_nodes, _maxEntries + 1, true, nullptr, o, key,
+                          &_pivots);
+      root->appendObject(o, key, 0);
+      _root.store(root);
+      return;
+    }
+    if (cow) {
+      cow->replaced.push_back(root);
+      root = root->copy();
+    }
+
+    bool rootOverflow = root->insert(o, key, _maxEntries, _split, cow);
+
+    // La raiz desbordada pasa a ser hijo de una raiz nueva y se divide ahi,
+    // asi el arbol crece en altura de manera uniforme.
+    if (rootOverflow) {
+      Node *oldRoot = root;
+      root = Node::create(_nodes, _maxEntries + 1, false, nullptr,
+                          oldRoot->pivot(), oldRoot->pivotKey(), &_pivots);
+      root->appendChild(oldRoot, 0);
+      root->splitChild(0, _split);
+    }
+    _root.store(root);
+  }
+
+  // Sin carga masiva los pivots son las primeras claves distintas; al
+  // completarse se miden las celdas de las hojas que ya existian
+  void notePivot(view_type key) {
+    for (view_type p : _pivots.keys())
+      if (Metric()(p, key) == 0)
+        return;
+    _pivots.addKey(key);
+    if (!_pivots.ready())
+      return;
+    std::vector<Node *> stack;
+    if (Node *root = _root.load())
+      stack.push_back(root);
+    while (!stack.empty()) {
+      Node *node = stack.back();
+      stack.pop_back();
+      if (node->isLeaf())
+        node->writePivotCells();
+      else
+        for (Node *child : node->children())
+          stack.push_back(child);
+    }
+  }
+
+  // Pivots de la carga masiva: el mas lejano primero sobre una muestra, asi
+  // quedan repartidos por el espacio. Sus claves se guardan en pool.
+  std::vector<view_type> choosePivots(const std::vector<Key *> &objs,
+                                      const std::vector<view_type> &keys,
+                                      store_type &pool, std::mt19937 &gen) {
+    const size_t sampleSize =
+        std::min(keys.size(), std::max<size_t>(256, 4 * _pivots.count()));
+    std::vector<size_t> sample(sampleSize);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    for (size_t &s : sample)
+      s = pick(gen);
+
+    // Con menos claves distintas que P algun pivot se repite; la cota sigue
+    // siendo valida
+    std::vector<size_t> chosen{sample[0]};
+    std::vector<distance_type> nearest(sample.size(), Dist::infinity());
+    while (chosen.size() < _pivots.count()) {
+      size_t far = 0;
+      for (size_t s = 0; s < sample.size(); ++s) {
+        nearest[s] = std::min(
+            nearest[s], Metric()(keys[chosen.back()], keys[sample[s]]));
+        if (nearest[s] > nearest[far])
+          far = s;
+      }
+      chosen.push_back(sample[far]);
+    }
+    std::vector<view_type> stored;
+    for (size_t idx : chosen)
+      stored.push_back(Metric::store(*objs[idx], pool));
+    return stored;
+  }
+
+  struct BulkGroup {
+    size_t center; // indice del pivot del grupo (es miembro del grupo)
+    std::vector<size_t> members;
+  };
+
+  template <class F>
+  static void parallelFor(size_t n, size_t threads, F &&fn) {
+    if (threads <= 1 || n < 2 * threads) {
+      for (size_t i = 0; i < n; ++i)
+        fn(i);
+      return;
+    }
+    std::vector<std::thread> workers;
+    size_t chunk = (n + threads - 1) / threads;
+    for (size_t t = 0; t < threads; ++t) {
+      size_t lo = t * chunk;
+      size_t hi = std::min(n, lo + chunk);
+      if (lo >= hi)
+        break;
+      workers.emplace_back([&fn, lo, hi]() {
+        for (size_t i = lo; i < hi; ++i)
+          fn(i);
+      });
+    }
+    for (std::thread &w : workers)
+      w.join();
+  }
+
+  // Cada worker toma tareas del frente de su rango y, al vaciarlo, roba del
+  // final del rango de otro: los bloques contiguos quedan en un mismo thread
+  // salvo cuando hace falta equilibrar. fn(tarea, worker).
+  template <class F>
+  static void stealingFor(size_t tasks, size_t threads, F &&fn) {
+    threads = std::max<size_t>(1, std::min(threads, tasks));
+    if (threads == 1) {
+      for (size_t t = 0; t < tasks; ++t)
+        fn(t, 0);
+      return;
+    }
+
+    struct alignas(64) Range {
+      std::mutex lock;
+      size_t next = 0, end = 0;
+    };
+    std::vector<Range> ranges(threads);
+    size_t chunk = (tasks + threads - 1) / threads;
+    for (size_t w = 0; w < threads; ++w) {
+      ranges[w].next = std::min(tasks, w * chunk);
+      ranges[w].end = std::min(tasks, (w + 1) * chunk);
+    }
+
+    auto work = [&](size_t w) {
+      for (;;) {
+        size_t task = tasks;
+        {
+          std::lock_guard<std::mutex> guard(ranges[w].lock);
+          if (ranges[w].next < ranges[w].end)
+            task = ranges[w].next++;
+        }
+        for (size_t v = 1; task == tasks && v < threads; ++v) {
+          Range &victim = ranges[(w + v) % threads];
+          std::lock_guard<std::mutex> guard(victim.lock);
+          if (victim.next < victim.end)
+            task = --victim.end;
+        }
+        if (task == tasks)
+          return;
+        fn(task, w);
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < threads; ++w)
+      workers.emplace_back(work, w);
+    work(0);
+    for (std::thread &t : workers)
+      t.join();
+  }
+
+  static void collectEntries(const Node *node, std::vector<Key *> &objs,
+                             std::vector<view_type> &keys) {
+    if (node->isLeaf()) {
+      for (size_t i = 0; i < node->size(); ++i) {
+        objs.push_back(node->leafEntries()[i].object);
+        keys.push_back(node->leafEntries()[i].key);
+      }
+      return;
+    }
+    for (const Node *child : node->children())
+      collectEntries(child, objs, keys);
+  }
+
+  // Reparte members en grupos de a lo mas _maxEntries: se toman semillas al
+  // azar, cada elemento va a la semilla mas cercana y los grupos grandes se
+  // vuelven a partir. Los grupos muy chicos se reasignan para no dejar nodos
+  // casi vacios.
+  void bulkPartition(const std::vector<view_type> &keys,
+                     std::vector<size_t> members, size_t center,
+                     std::vector<BulkGroup> &out, std::mt19937 &gen,
+                     size_t threads) const {
+    const size_t n = members.size();
+    if (n <= _maxEntries) {
+      out.push_back({center, std::move(members)});
+      return;
+    }
+
+    size_t seeds = std::min(_maxEntries, (n + _maxEntries - 1) / _maxEntries);
+    seeds = std::max<size_t>(seeds, 2);
+    for (size_t s = 0; s < seeds; ++s) {
+      std::uniform_int_distribution<size_t> pick(s, n - 1);
+      std::swap(members[s], members[pick(gen)]);
+    }
+
+    std::vector<size_t> owner(n);
+    parallelFor(n, threads, [&](size_t i) {
+      if (i < seeds) {
+        owner[i] = i;
+        return;
+      }
+      view_type key = keys[members[i]];
+      size_t best = 0;
+      distance_type bestDist = Metric()(key, keys[members[0]]);
+      for (size_t s = 1; s < seeds && bestDist > 0; ++s) {
+        distance_type d =
+            Metric().atMost(key, keys[members[s]], Dist::below(bestDist));
+        if (d < bestDist) {
+          bestDist = d;
+          best = s;
+        }
+      }
+      owner[i] = best;
+    });
+
+    std::vector<size_t> counts(seeds, 0);
+    for (size_t i = 0; i < n; ++i)
+      counts[owner[i]]++;
+
+    const size_t minFill = std::max<size_t>(2, _maxEntries / 4);
+    std::vector<size_t> kept;
+    for (size_t s = 0; s < seeds; ++s)
+      if (counts[s] >= minFill)
+        kept.push_back(s);
+
+    if (!kept.empty() && kept.size() < seeds) {
+      for (size_t i = 0; i < n; ++i) {
+        if (counts[owner[i]] >= minFill)
+          continue;
+        view_type key = keys[members[i]];
+        size_t best = kept[0];
+        distance_type bestDist = Metric()(key, keys[members[kept[0]]]);
+        for (size_t k = 1; k < kept.size() && bestDist > 0; ++k) {
+          distance_type d = Metric().atMost(key, keys[members[kept[k]]],
+                                            Dist::below(bestDist));
+          if (d < bestDist) {
+            bestDist = d;
+            best = kept[k];
+          }
+        }
+        owner[i] = best;
+      }
+    }
+
+    std::vector<std::vector<size_t>> parts(seeds);
+    for (size_t i = 0; i < n; ++i)
+      parts[owner[i]].push_back(members[i]);
+
+    size_t nonEmpty = 0;
+    for (const auto &part : parts)
+      if (!part.empty())
+        nonEmpty++;
+
+    // Todo cayo en una semilla (p. ej. claves repetidas): se corta en trozos
+    if (nonEmpty < 2) {
+      size_t chunk = (n + seeds - 1) / seeds;
+      for (size_t lo = 0; lo < n; lo += chunk) {
+        std::vector<size_t> part(members.begin() + lo,
+                                 members.begin() + std::min(n, lo + chunk));
+        size_t c = part[0];
+        bulkPartition(keys, std::move(part), c, out, gen, threads);
+      }
+      return;
+    }
+
+    for (size_t s = 0; s < seeds; ++s) {
+      if (parts[s].empty())
+        continue;
+      bulkPartition(keys, std::move(parts[s]), members[s], out, gen, threads);
+    }
   }
 };
 
+// El arbol original: cadenas (Object) con distancia de edicion
+using MNode = BasicMNode<Object, LevenshteinMetric>;
+using MTree = BasicMTree<Object, LevenshteinMetric>;
+using MLeafEntry = MNode::LeafEntry;
+using MRoutingEntry = MNode::RoutingEntry;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,585 @@
+// Benchmarks del M-tree.
+// Compilar: g++ -std=c++17 -O2 -pthread bench.cpp -o bench
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentMtree.h"
+#include "Levenshtein.h"
+#include "MTreeFile.h"
+#include "Mtree.h"
+#include "Object.h"
+
+using Clock = std::chrono::steady_clock;
+
+std::string randomString(std::mt19937 &gen, std::size_t len = 9) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "0123456789";
+  std::uniform_int_distribution<> d(0, sizeof(alphabet) - 2);
+  std::string s;
+  s.reserve(len);
+  for (std::size_t i = 0; i < len; ++i)
+    s.push_back(alphabet[d(gen)]);
+  return s;
+}
+
+// Datos con estructura: variantes con pocas ediciones de unas cuantas bases,
+// parecido a un diccionario con errores de tipeo
+std::vector<Object> clusteredObjects(std::mt19937 &gen, std::size_t n,
+                                     std::size_t bases = 500) {
+  std::vector<std::string> roots;
+  for (std::size_t i = 0; i < bases; ++i)
+    roots.push_back(randomString(gen, 12));
+  std::uniform_int_distribution<std::size_t> pickRoot(0, bases - 1);
+  std::uniform_int_distribution<int> edits(0, 3);
+  std::vector<Object> out;
+  out.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    std::string s = roots[pickRoot(gen)];
+    for (int e = edits(gen); e > 0; --e) {
+      std::uniform_int_distribution<std::size_t> pos(0, s.size() - 1);
+      s[pos(gen)] = randomString(gen, 1)[0];
+    }
+    out.emplace_back(s);
+  }
+  return out;
+}
+
+// Nanosegundos por llamada de `kernel` sobre todos los pares (a[i], b[i])
+using Kernel =
+    std::function<std::size_t(const std::string &, const std::string &)>;
+
+double nsPerCall(const std::vector<std::string> &a,
+                 const std::vector<std::string> &b, std::size_t rounds,
+                 const Kernel &kernel) {
+  std::size_t sink = 0;
+  auto start = Clock::now();
+  for (std::size_t r = 0; r < rounds; ++r)
+    for (std::size_t i = 0; i < a.size(); ++i)
+      sink += kernel(a[i], b[i]);
+  auto end = Clock::now();
+  if (sink == 1)
+    std::cout << "";
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  return ns / static_cast<double>(rounds * a.size());
+}
+
+// -------------------------------------------------------------
+// Nucleos de Levenshtein: DP de referencia vs banda vs bits
+// -------------------------------------------------------------
+void benchKernels(std::mt19937 &gen) {
+  std::cout << "=== Levenshtein (ns/llamada) ===\n";
+  std::cout << std::setw(6) << "len" << std::setw(12) << "reference"
+            << std::setw(12) << "banded" << std::setw(12) << "bitpar"
+            << std::setw(12) << "banded<=2" << std::setw(12) << "bitpar<=2"
+            << '\n';
+
+  const std::size_t lengths[] = {9, 32, 64, 128, 300};
+  for (std::size_t len : lengths) {
+    const std::size_t pairs = 2000;
+    std::vector<std::string> a, b;
+    for (std::size_t i = 0; i < pairs; ++i) {
+      a.push_back(randomString(gen, len));
+      b.push_back(randomString(gen, len));
+    }
+    const std::size_t rounds = len <= 64 ? 20 : 2;
+    const std::size_t full = len;
+
+    double ref = nsPerCall(a, b, rounds, [](const std::string &x,
+                                            const std::string &y) {
+      return levenshtein::reference(x, y);
+    });
+    double band = nsPerCall(a, b, rounds, [full](const std::string &x,
+                                                 const std::string &y) {
+      return levenshtein::banded(x, y, full);
+    });
+    double bits = nsPerCall(a, b, rounds, [len, full](const std::string &x,
+                                                 const std::string &y) {
+      return len <= levenshtein::kWord ? levenshtein::myers64(x, y, full)
+                                       : levenshtein::myersBlocks(x, y, full);
+    });
+    double bandK = nsPerCall(a, b, rounds, [](const std::string &x,
+                                              const std::string &y) {
+      return levenshtein::banded(x, y, 2);
+    });
+    double bitsK = nsPerCall(a, b, rounds, [len](const std::string &x,
+                                                 const std::string &y) {
+      return len <= levenshtein::kWord ? levenshtein::myers64(x, y, 2)
+                                       : levenshtein::myersBlocks(x, y, 2);
+    });
+
+    std::cout << std::fixed << std::setprecision(1) << std::setw(6) << len
+              << std::setw(12) << ref << std::setw(12) << band << std::setw(12)
+              << bits << std::setw(12) << bandK << std::setw(12) << bitsK
+              << '\n';
+  }
+}
+
+// -------------------------------------------------------------
+// rangeSearch: distancias calculadas vs evitadas por consulta
+// -------------------------------------------------------------
+void benchRangeFiltering(std::mt19937 &gen) {
+  const std::size_t N = 20000;
+  const std::size_t queries = 200;
+
+  std::vector<std::unique_ptr<Object>> data;
+  MTree tree(10);
+  for (std::size_t i = 0; i < N; ++i) {
+    data.push_back(std::make_unique<Object>(randomString(gen)));
+    tree.insert(*data.back());
+  }
+
+  std::cout << "\n=== rangeSearch, N=" << N << " (por consulta) ===\n";
+  std::cout << std::setw(8) << "radius" << std::setw(14) << "computed"
+            << std::setw(14) << "avoided" << std::setw(12) << "us" << '\n';
+  std::uniform_int_distribution<std::size_t> pick(0, N - 1);
+  for (std::size_t radius = 1; radius <= 7; radius += 2) {
+    MQueryStats st;
+    auto start = Clock::now();
+    for (std::size_t q = 0; q < queries; ++q)
+      tree.rangeSearch(*data[pick(gen)], radius, &st);
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start)
+                    .count();
+    std::cout << std::setw(8) << radius << std::setw(14)
+              << st.distanceComputations / queries << std::setw(14)
+              << st.distancesAvoided / queries << std::setw(12)
+              << us / queries << '\n';
+  }
+}
+
+// Forma del arbol, costo promedio de consultas (distancias por consulta) y
+// memoria reservada por entrada
+void reportQueryCost(const MTree &tree, const std::vector<Object> &queries) {
+  MQueryStats range, knn;
+  for (const Object &q : queries) {
+    tree.rangeSearch(q, 2, &range);
+    tree.kNearestNeighbors(q, 5, &knn);
+  }
+  MTreeStats shape = tree.statistics();
+  std::cout << std::setw(8) << shape.height << std::setw(10)
+            << std::setprecision(1) << 100.0 * shape.overlapRatio()
+            << std::setw(14) << range.distanceComputations / queries.size()
+            << std::setw(14) << knn.distanceComputations / queries.size()
+            << std::setw(10) << tree.storageBytes() / shape.entries;
+}
+
+void printQueryCostHeader() {
+  std::cout << std::setw(8) << "height" << std::setw(10) << "overlap%"
+            << std::setw(14) << "range r=2" << std::setw(14) << "knn k=5"
+            << std::setw(10) << "B/entry" << '\n';
+}
+
+// -------------------------------------------------------------
+// bulkLoad vs insert secuencial
+// -------------------------------------------------------------
+void benchBulkLoad(std::mt19937 &gen) {
+  const std::size_t N = 20000;
+  std::vector<Object> objects;
+  for (std::size_t i = 0; i < N; ++i)
+    objects.emplace_back(randomString(gen));
+  std::vector<Object> queries;
+  for (std::size_t i = 0; i < 100; ++i)
+    queries.emplace_back(randomString(gen));
+
+  std::cout << "\n=== Construccion, N=" << N << " ===\n";
+  std::cout << std::setw(18) << "metodo" << std::setw(12) << "ms";
+  printQueryCostHeader();
+
+  {
+    MTree tree(10);
+    auto start = Clock::now();
+    for (const Object &o : objects)
+      tree.insert(o);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start)
+                    .count();
+    std::cout << std::setw(18) << "insert" << std::setw(12) << ms;
+    reportQueryCost(tree, queries);
+    std::cout << '\n';
+  }
+
+  const std::size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t threads : {std::size_t(1), hw}) {
+    MTree tree(10);
+    auto start = Clock::now();
+    tree.bulkLoad(objects, threads);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start)
+                    .count();
+    std::cout << std::setw(12) << "bulkLoad x" << std::setw(6) << threads
+              << std::setw(12) << ms;
+    reportQueryCost(tree, queries);
+    std::cout << '\n';
+    if (hw == 1)
+      break;
+  }
+}
+
+// -------------------------------------------------------------
+// Politicas de division: costo de split y costo de consulta
+// -------------------------------------------------------------
+void benchSplitPolicies(std::mt19937 &gen) {
+  const std::size_t N = 20000;
+  std::vector<Object> objects = clusteredObjects(gen, N);
+  std::vector<Object> queries = clusteredObjects(gen, 100);
+
+  struct Named {
+    const char *name;
+    SplitPolicy policy;
+  };
+  const Named policies[] = {
+      {"max-dist/hyper",
+       {PromotePolicy::MaxDistance, PartitionPolicy::Hyperplane}},
+      {"random/hyper", {PromotePolicy::Random, PartitionPolicy::Hyperplane}},
+      {"mM_RAD/hyper",
+       {PromotePolicy::SampledMMRad, PartitionPolicy::Hyperplane}},
+      {"M_LB_DIST/hyper",
+       {PromotePolicy::MLBDist, PartitionPolicy::Hyperplane}},
+      {"max-dist/balanced",
+       {PromotePolicy::MaxDistance, PartitionPolicy::Balanced}},
+      {"M_LB_DIST/balanced",
+       {PromotePolicy::MLBDist, PartitionPolicy::Balanced}},
+  };
+
+  std::cout << "\n=== Politicas de split, N=" << N << " (agrupados) ===\n";
+  std::cout << std::setw(20) << "politica" << std::setw(10) << "ms"
+            << std::setw(10) << "splits" << std::setw(12) << "dist/split";
+  printQueryCostHeader();
+  for (const Named &p : policies) {
+    MTree tree(10, p.policy);
+    auto start = Clock::now();
+    for (const Object &o : objects)
+      tree.insert(o);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start)
+                    .count();
+    const MSplitStats &st = tree.splitStats();
+    std::cout << std::setw(20) << p.name << std::setw(10) << ms
+              << std::setw(10) << st.splits << std::setw(12)
+              << (st.splits ? st.distanceComputations / st.splits : 0);
+    reportQueryCost(tree, queries);
+    std::cout << '\n';
+  }
+}
+
+// -------------------------------------------------------------
+// Lectores concurrentes con un escritor: ConcurrentMTree vs mutex global
+// -------------------------------------------------------------
+// Consultas por segundo de `readers` hilos durante `window` mientras un
+// escritor inserta `writes` objetos
+template <class Query, class Insert>
+double readThroughput(std::size_t readers, const std::vector<Object> &queries,
+                      const std::deque<Object> &writes,
+                      std::chrono::milliseconds window, Query query,
+                      Insert insert) {
+  std::atomic<bool> stop{false};
+  std::atomic<std::size_t> done{0};
+  std::vector<std::thread> pool;
+  for (std::size_t r = 0; r < readers; ++r) {
+    pool.emplace_back([&, r]() {
+      std::size_t i = r, local = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        query(queries[i++ % queries.size()]);
+        local++;
+      }
+      done += local;
+    });
+  }
+  std::thread writer([&]() {
+    for (const Object &o : writes) {
+      if (stop.load(std::memory_order_relaxed))
+        break;
+      insert(o);
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+  auto start = Clock::now();
+  std::this_thread::sleep_for(window);
+  stop = true;
+  for (std::thread &t : pool)
+    t.join();
+  writer.join();
+  double s = std::chrono::duration<double>(Clock::now() - start).count();
+  return done / s;
+}
+
+void benchConcurrentReads(std::mt19937 &gen) {
+  const std::size_t N = 20000;
+  const auto window = std::chrono::milliseconds(500);
+  std::vector<Object> objects = clusteredObjects(gen, N);
+  std::vector<Object> queries = clusteredObjects(gen, 256);
+  std::deque<Object> writes;
+  for (const Object &o : clusteredObjects(gen, 10000))
+    writes.push_back(o);
+
+  ConcurrentMTree shared(10);
+  MTree locked(10);
+  std::mutex lock;
+  for (const Object &o : objects) {
+    shared.insert(o);
+    locked.insert(o);
+  }
+
+  std::cout << "\n=== Lectores concurrentes (kNN k=5 + search), N=" << N
+            << ", un escritor ===\n";
+  std::cout << std::setw(8) << "threads" << std::setw(14) << "cow q/s"
+            << std::setw(14) << "mutex q/s" << std::setw(10) << "ratio"
+            << '\n';
+  const std::size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t readers = 1; readers <= std::max<std::size_t>(hw, 4);
+       readers *= 2) {
+    double cow = readThroughput(
+        readers, queries, writes, window,
+        [&](const Object &q) {
+          shared.kNearestNeighbors(q, 5);
+          shared.search(q);
+        },
+        [&](const Object &o) { shared.insert(o); });
+    double mtx = readThroughput(
+        readers, queries, writes, window,
+        [&](const Object &q) {
+          std::lock_guard<std::mutex> guard(lock);
+          locked.kNearestNeighbors(q, 5);
+          locked.search(q);
+        },
+        [&](const Object &o) {
+          std::lock_guard<std::mutex> guard(lock);
+          locked.insert(o);
+        });
+    std::cout << std::setw(8) << readers << std::setw(14) << std::setprecision(0)
+              << cow << std::setw(14) << mtx << std::setw(10)
+              << std::setprecision(2) << cow / mtx << '\n';
+  }
+}
+
+// -------------------------------------------------------------
+// Consultas en lote: QPS segun el numero de threads
+// -------------------------------------------------------------
+void benchBatch(std::mt19937 &gen) {
+  const std::size_t N = 50000;
+  std::vector<Object> objects = clusteredObjects(gen, N);
+  std::vector<Object> queries = clusteredObjects(gen, 10000);
+  MTree tree(10);
+  tree.bulkLoad(objects);
+
+  std::cout << "\n=== Lotes de " << queries.size() << " consultas, N=" << N
+            << " (agrupados) ===\n";
+  std::cout << std::setw(8) << "threads" << std::setw(14) << "range r=1"
+            << std::setw(14) << "knn k=5" << "   (consultas/s)\n";
+  const std::size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t threads = 1; threads <= hw; threads *= 2) {
+    auto start = Clock::now();
+    tree.rangeSearchBatch(queries, 1, threads);
+    double range = std::chrono::duration<double>(Clock::now() - start).count();
+    start = Clock::now();
+    tree.kNearestNeighborsBatch(queries, 5, threads);
+    double knn = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << std::setw(8) << threads << std::setw(14)
+              << std::setprecision(0) << queries.size() / range
+              << std::setw(14) << queries.size() / knn << '\n';
+  }
+}
+
+// -------------------------------------------------------------
+// Arranque en frio: reconstruir vs abrir el archivo mapeado
+// -------------------------------------------------------------
+void benchColdStart(std::mt19937 &gen) {
+  const std::size_t N = 200000;
+  const std::string path = "bench_mtree.idx";
+  std::vector<Object> objects = clusteredObjects(gen, N, 5000);
+  std::vector<Object> queries = clusteredObjects(gen, 100, 5000);
+
+  auto ms = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  std::cout << "\n=== Arranque en frio, N=" << N << " ===\n";
+  MTree tree(10);
+  auto start = Clock::now();
+  tree.bulkLoad(objects);
+  std::cout << std::setw(26) << "bulkLoad" << std::setw(10)
+            << std::setprecision(1) << ms(start) << " ms\n";
+
+  start = Clock::now();
+  saveMTree(tree, path);
+  std::cout << std::setw(26) << "saveMTree" << std::setw(10) << ms(start)
+            << " ms\n";
+
+  for (bool verify : {true, false}) {
+    start = Clock::now();
+    MappedMTree mapped(path, verify);
+    double open = ms(start);
+    start = Clock::now();
+    std::size_t found = 0;
+    for (const Object &q : queries)
+      found += mapped.kNearestNeighbors(q.str(), 5).size();
+    std::cout << std::setw(26)
+              << (verify ? "mmap + checksum" : "mmap sin checksum")
+              << std::setw(10) << open << " ms  (" << mapped.header().fileSize
+              << " B, k-NN " << ms(start) / queries.size() << " ms/consulta, "
+              << found << " vecinos)\n";
+  }
+  std::remove(path.c_str());
+}
+
+// -------------------------------------------------------------
+// Rotacion del diccionario: borrar 1% vs reconstruir
+// -------------------------------------------------------------
+void benchChurn(std::mt19937 &gen) {
+  const std::size_t N = 50000;
+  std::vector<Object> objects = clusteredObjects(gen, N);
+  std::vector<Object> stale(objects.begin(), objects.begin() + N / 100);
+  std::vector<Object> kept(objects.begin() + N / 100, objects.end());
+
+  auto ms = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  std::cout << "\n=== Borrar " << stale.size() << " de N=" << N
+            << " (agrupados) ===\n";
+  {
+    MTree tree(10);
+    tree.bulkLoad(objects);
+    auto start = Clock::now();
+    for (const Object &o : stale)
+      tree.erase(o);
+    std::cout << std::setw(26) << "erase uno por uno" << std::setw(10)
+              << std::setprecision(1) << ms(start) << " ms\n";
+  }
+  {
+    MTree tree(10);
+    tree.bulkLoad(objects);
+    auto start = Clock::now();
+    tree.erase(stale);
+    MTreeStats st = tree.statistics();
+    std::cout << std::setw(26) << "erase en lote" << std::setw(10)
+              << ms(start) << " ms  (height=" << st.height
+              << ", balanced=" << (st.balanced ? "yes" : "no") << ")\n";
+  }
+  {
+    MTree tree(10);
+    auto start = Clock::now();
+    tree.bulkLoad(kept);
+    std::cout << std::setw(26) << "bulkLoad sin los borrados" << std::setw(10)
+              << ms(start) << " ms\n";
+  }
+}
+
+// -------------------------------------------------------------
+// Busqueda exacta: radio 0 en el arbol vs indice hash
+// -------------------------------------------------------------
+void benchHashIndex(std::mt19937 &gen) {
+  const std::size_t N = 50000;
+  std::vector<Object> objects = clusteredObjects(gen, N);
+  std::vector<Object> queries = clusteredObjects(gen, 2000);
+  queries.insert(queries.end(), objects.begin(), objects.begin() + 2000);
+  std::vector<Object> stale(objects.begin(), objects.begin() + N / 100);
+
+  std::cout << "\n=== search exacto, N=" << N << ", " << queries.size()
+            << " consultas ===\n";
+  std::cout << std::setw(12) << "indice" << std::setw(14) << "us/consulta"
+            << std::setw(14) << "dist/consulta" << std::setw(16)
+            << "indice B/obj" << std::setw(18) << "erase 1% lote ms\n";
+  for (bool indexed : {false, true}) {
+    MTree tree(10);
+    tree.setHashIndex(indexed);
+    tree.bulkLoad(objects);
+    MQueryStats st;
+    std::size_t found = 0;
+    auto start = Clock::now();
+    for (const Object &q : queries)
+      found += tree.search(q, &st);
+    double us =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count();
+    MTreeStats shape = tree.statistics();
+    start = Clock::now();
+    tree.erase(stale);
+    double eraseMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    std::cout << std::setw(12) << (indexed ? "si" : "no") << std::setw(14)
+              << std::setprecision(2) << us / queries.size() << std::setw(14)
+              << std::setprecision(0)
+              << double(st.distanceComputations) / queries.size()
+              << std::setw(16) << std::setprecision(1)
+              << double(shape.indexBytes) / N << std::setw(17) << eraseMs
+              << "   (" << found << " encontrados)\n";
+  }
+}
+
+// -------------------------------------------------------------
+// Pivots globales en las hojas: distancias y tiempo de consulta
+// -------------------------------------------------------------
+void benchPivots(std::mt19937 &gen) {
+  const std::size_t N = 50000;
+  // Consultas de la misma distribucion: una consulta lejos de todo queda a
+  // la misma distancia de cada pivot y la cota no descarta nada
+  for (std::size_t bases : {500, 40}) {
+    std::vector<Object> objects = clusteredObjects(gen, N + 200, bases);
+    std::vector<Object> queries(objects.end() - 200, objects.end());
+    objects.erase(objects.end() - 200, objects.end());
+
+    std::cout << "\n=== Pivots globales, N=" << N << ", " << bases
+              << " bases, " << queries.size() << " consultas ===\n";
+    std::cout << std::setw(12) << "pivots" << std::setw(14) << "range dist"
+              << std::setw(12) << "range us" << std::setw(14) << "knn dist"
+              << std::setw(12) << "knn us" << std::setw(10) << "B/entry\n";
+    for (std::size_t count : {0, 8, 16}) {
+      for (bool wide : {false, true}) {
+        if (wide && count == 0)
+          continue;
+        MPivotOptions options;
+        options.count = count;
+        options.wide = wide;
+        MTree tree(10, SplitPolicy(), options);
+        tree.bulkLoad(objects);
+
+        MQueryStats range, knn;
+        auto start = Clock::now();
+        for (const Object &q : queries)
+          tree.rangeSearch(q, 2, &range);
+        double rangeUs =
+            std::chrono::duration<double, std::micro>(Clock::now() - start)
+                .count();
+        start = Clock::now();
+        for (const Object &q : queries)
+          tree.kNearestNeighbors(q, 5, &knn);
+        double knnUs =
+            std::chrono::duration<double, std::micro>(Clock::now() - start)
+                .count();
+        std::cout << std::setw(9) << count << (wide ? " x16" : " x8 ")
+                  << std::setw(14)
+                  << range.distanceComputations / queries.size()
+                  << std::setw(12) << std::setprecision(0)
+                  << rangeUs / queries.size() << std::setw(14)
+                  << knn.distanceComputations / queries.size()
+                  << std::setw(12) << knnUs / queries.size() << std::setw(9)
+                  << tree.storageBytes() / N << '\n';
+      }
+    }
+  }
+}
+
+int main() {
+  std::mt19937 gen(42);
+  benchKernels(gen);
+  benchRangeFiltering(gen);
+  benchBulkLoad(gen);
+  benchSplitPolicies(gen);
+  benchConcurrentReads(gen);
+  benchBatch(gen);
+  benchColdStart(gen);
+  benchChurn(gen);
+  benchHashIndex(gen);
+  benchPivots(gen);
+  return 0;
+}
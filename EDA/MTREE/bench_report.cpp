@@ -0,0 +1,213 @@
+// Benchmark del M-tree con salida JSON para seguir regresiones.
+// Compilar: g++ -std=c++17 -O2 -pthread bench_report.cpp -o bench_report
+// Uso: ./bench_report [--sizes 10000,100000,1000000] [--queries 1000]
+//                     [--radii 1,2,3] [--k 1,10,100] [--out reporte.json]
+// Para 10^7 cadenas: --sizes 10000000 (varios GB de memoria).
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Mtree.h"
+#include "Object.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::vector<std::size_t> sizes = {10000, 100000, 1000000};
+  std::size_t queries = 1000;
+  std::vector<std::size_t> radii = {1, 2, 3};
+  std::vector<std::size_t> ks = {1, 10, 100};
+  std::string out; // vacio = stdout
+};
+
+std::vector<std::size_t> parseList(const std::string &text) {
+  std::vector<std::size_t> values;
+  std::stringstream in(text);
+  std::string item;
+  while (std::getline(in, item, ','))
+    values.push_back(std::stoull(item));
+  return values;
+}
+
+bool parseOptions(int argc, char **argv, Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Falta el valor de " << flag << '\n';
+      return false;
+    }
+    std::string value = argv[++i];
+    if (flag == "--sizes")
+      opt.sizes = parseList(value);
+    else if (flag == "--queries")
+      opt.queries = std::stoull(value);
+    else if (flag == "--radii")
+      opt.radii = parseList(value);
+    else if (flag == "--k")
+      opt.ks = parseList(value);
+    else if (flag == "--out")
+      opt.out = value;
+    else {
+      std::cerr << "Opcion desconocida: " << flag << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string randomString(std::mt19937 &gen, std::size_t len) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "0123456789";
+  std::uniform_int_distribution<> d(0, sizeof(alphabet) - 2);
+  std::string s(len, ' ');
+  for (char &c : s)
+    c = alphabet[d(gen)];
+  return s;
+}
+
+// Variantes con pocas ediciones de n / 100 bases, como un diccionario con
+// errores de tipeo
+std::vector<std::string> clusteredStrings(std::mt19937 &gen, std::size_t n) {
+  std::vector<std::string> roots(std::max<std::size_t>(1, n / 100));
+  for (std::string &r : roots)
+    r = randomString(gen, 12);
+  std::uniform_int_distribution<std::size_t> pickRoot(0, roots.size() - 1);
+  std::uniform_int_distribution<int> edits(0, 3);
+  std::uniform_int_distribution<std::size_t> pos(0, 11);
+  std::vector<std::string> out(n);
+  for (std::string &s : out) {
+    s = roots[pickRoot(gen)];
+    for (int e = edits(gen); e > 0; --e)
+      s[pos(gen)] = randomString(gen, 1)[0];
+  }
+  return out;
+}
+
+// Latencias (ns) y contadores de un tipo de consulta
+struct Series {
+  std::string kind;
+  std::size_t param = 0;
+  std::vector<double> latencies;
+  MQueryStats stats;
+  std::size_t results = 0;
+};
+
+double percentile(std::vector<double> sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  std::sort(sorted.begin(), sorted.end());
+  std::size_t idx = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[idx];
+}
+
+// query devuelve la cantidad de resultados y acumula sus contadores en st
+Series measure(const std::string &kind, std::size_t param,
+               const std::vector<Object> &queries,
+               const std::function<std::size_t(const Object &,
+                                               MQueryStats &)> &query) {
+  Series s;
+  s.kind = kind;
+  s.param = param;
+  for (const Object &q : queries) {
+    auto start = Clock::now();
+    s.results += query(q, s.stats);
+    s.latencies.push_back(
+        std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count());
+  }
+  return s;
+}
+
+void writeSeries(std::ostream &out, const Series &s) {
+  const double n = static_cast<double>(s.latencies.size());
+  out << "        {\"kind\": \"" << s.kind << "\", \"param\": " << s.param
+      << ", \"p50_ns\": " << percentile(s.latencies, 0.50)
+      << ", \"p90_ns\": " << percentile(s.latencies, 0.90)
+      << ", \"p99_ns\": " << percentile(s.latencies, 0.99)
+      << ", \"max_ns\": " << percentile(s.latencies, 1.0)
+      << ", \"distances_per_query\": " << s.stats.distanceComputations / n
+      << ", \"avoided_per_query\": " << s.stats.distancesAvoided / n
+      << ", \"nodes_per_query\": " << s.stats.nodesVisited / n
+      << ", \"results_per_query\": " << s.results / n << "}";
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt))
+    return 1;
+
+  std::ofstream file;
+  if (!opt.out.empty())
+    file.open(opt.out);
+  std::ostream &out = opt.out.empty() ? std::cout : file;
+  out.precision(6);
+
+  std::mt19937 gen(42);
+  out << "{\n  \"queries\": " << opt.queries << ",\n  \"runs\": [\n";
+  for (std::size_t r = 0; r < opt.sizes.size(); ++r) {
+    const std::size_t n = opt.sizes[r];
+    std::vector<std::string> strings = clusteredStrings(gen, n);
+
+    // Mitad de consultas son claves del arbol y mitad al azar
+    std::vector<Object> queries;
+    std::uniform_int_distribution<std::size_t> member(0, n - 1);
+    for (std::size_t i = 0; i < opt.queries; ++i)
+      queries.emplace_back(i % 2 ? strings[member(gen)]
+                                 : randomString(gen, 12));
+    std::vector<Object> objects;
+    objects.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+      objects.emplace_back(std::move(strings[i]));
+    strings.clear();
+    strings.shrink_to_fit();
+
+    MTree tree(10);
+    auto start = Clock::now();
+    tree.bulkLoad(std::move(objects));
+    double buildMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    MTreeStats shape = tree.statistics();
+
+    std::vector<Series> series;
+    series.push_back(measure("exact", 0, queries,
+                             [&](const Object &q, MQueryStats &st) {
+                               return std::size_t(tree.search(q, &st));
+                             }));
+    for (std::size_t radius : opt.radii)
+      series.push_back(measure("range", radius, queries,
+                               [&](const Object &q, MQueryStats &st) {
+                                 return tree.rangeSearch(q, radius, &st)
+                                     .size();
+                               }));
+    for (std::size_t k : opt.ks)
+      series.push_back(measure("knn", k, queries,
+                               [&](const Object &q, MQueryStats &st) {
+                                 return tree.kNearestNeighbors(q, k, &st)
+                                     .size();
+                               }));
+
+    out << "    {\"size\": " << n << ", \"build_ms\": " << buildMs
+        << ", \"height\": " << shape.height << ", \"nodes\": " << shape.nodes
+        << ", \"bytes_per_entry\": "
+        << double(tree.storageBytes()) / shape.entries
+        << ",\n      \"series\": [\n";
+    for (std::size_t i = 0; i < series.size(); ++i) {
+      writeSeries(out, series[i]);
+      out << (i + 1 < series.size() ? ",\n" : "\n");
+    }
+    out << "      ]}" << (r + 1 < opt.sizes.size() ? ",\n" : "\n");
+    std::cerr << "N=" << n << " listo\n";
+  }
+  out << "  ]\n}\n";
+  return 0;
+}